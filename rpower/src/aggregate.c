@@ -0,0 +1,190 @@
+#include <pthread.h>
+#include "utilities.h"
+#include "power.h"
+#include "linalg.h"
+#include "aggregate.h"
+
+static const double quantilep[AGGQUANTILES] = {0.05, 0.5, 0.95};
+
+static void addmoments(aggmoments *pmoments, double x)
+{
+	double delta = x - pmoments->mean;
+
+	if (pmoments->count == 0 || x < pmoments->min)
+		pmoments->min = x;
+	if (pmoments->count == 0 || x > pmoments->max)
+		pmoments->max = x;
+	++pmoments->count;
+	pmoments->mean += delta/pmoments->count;
+	pmoments->m2 += delta*(x - pmoments->mean);
+}
+
+static double deviation(aggmoments *pmoments)
+{
+	return pmoments->count > 1 ? sqrt(pmoments->m2/(pmoments->count - 1)) : 0;
+}
+
+/** width of the 95% confidence interval on the mean **/
+double AGGwidth(aggmoments *pmoments)
+{
+	return pmoments->count > 1 ? 2*AGGZ95*deviation(pmoments)/sqrt((double) pmoments->count) : HUGE_VAL;
+}
+
+static void initquantile(aggquantile *pq, double p)
+{
+	memset(pq, 0, sizeof(aggquantile));
+	pq->p = p;
+	pq->desired[0] = 1; pq->desired[1] = 1 + 2*p; pq->desired[2] = 1 + 4*p; pq->desired[3] = 3 + 2*p; pq->desired[4] = 5;
+	pq->increment[0] = 0; pq->increment[1] = p/2; pq->increment[2] = p; pq->increment[3] = (1 + p)/2; pq->increment[4] = 1;
+}
+
+static void addquantile(aggquantile *pq, double x)
+{
+	int i, k;
+	double *q = pq->height, *pos = pq->position, d, move;
+
+	if (pq->count < 5) {
+		/** insertion into the first observations, kept sorted **/
+		for (i = pq->count; i > 0 && q[i - 1] > x; i--)
+			q[i] = q[i - 1];
+		q[i] = x;
+		pos[pq->count] = pq->count + 1;
+		++pq->count;
+		return;
+	}
+	++pq->count;
+
+	/** cell of x, the extreme markers follow the min and the max **/
+	if (x < q[0]) {
+		q[0] = x;
+		k = 0;
+	}
+	else if (x >= q[4]) {
+		if (x > q[4])
+			q[4] = x;
+		k = 3;
+	}
+	else
+		for (k = 0; k < 3 && x >= q[k + 1]; k++);
+	for (i = k + 1; i < 5; i++)
+		pos[i] += 1;
+	for (i = 0; i < 5; i++)
+		pq->desired[i] += pq->increment[i];
+
+	/** middle markers off their desired position by one or more move by one, on a parabola if it stays in order **/
+	for (i = 1; i < 4; i++) {
+		d = pq->desired[i] - pos[i];
+		if ((d >= 1 && pos[i + 1] - pos[i] > 1) || (d <= -1 && pos[i - 1] - pos[i] < -1)) {
+			move = d > 0 ? 1 : -1;
+			d = q[i] + move/(pos[i + 1] - pos[i - 1])*((pos[i] - pos[i - 1] + move)*(q[i + 1] - q[i])/(pos[i + 1] - pos[i])
+					+ (pos[i + 1] - pos[i] - move)*(q[i] - q[i - 1])/(pos[i] - pos[i - 1]));
+			if (q[i - 1] < d && d < q[i + 1])
+				q[i] = d;
+			else
+				q[i] += move*(q[i + (int) move] - q[i])/(pos[i + (int) move] - pos[i]);
+			pos[i] += move;
+		}
+	}
+}
+
+static double quantile(aggquantile *pq)
+{
+	int i;
+
+	if (pq->count == 0)
+		return 0;
+	if (pq->count <= 5) {
+		/** nearest rank, the markers only move from the sixth observation on **/
+		i = (int) ceil(pq->p*pq->count) - 1;
+		return pq->height[i < 0 ? 0 : i];
+	}
+	return pq->height[2];
+}
+
+/** epsilon: width of the 95% interval on the top eigen value that ends the run, 0 for none **/
+int AGGinit(pwraggregate *pagg, int n, int r, double epsilon)
+{
+	int f, j;
+
+	memset(pagg, 0, sizeof(pwraggregate));
+	pagg->n = n;
+	pagg->r = r;
+	pagg->epsilon = epsilon;
+	pagg->value = (aggmoments *)calloc(2*r, sizeof(aggmoments));
+	pagg->quantile = (aggquantile *)calloc((size_t)r*AGGQUANTILES, sizeof(aggquantile));
+	pagg->reference = (double *)calloc((size_t)r*n, sizeof(double));
+	if (!pagg->value || !pagg->quantile || !pagg->reference) {
+		AGGfree(pagg);
+		return NOMEMORY;
+	}
+	pagg->angle = &pagg->value[r];
+	for (f = 0; f < r; f++)
+		for (j = 0; j < AGGQUANTILES; j++)
+			initquantile(&pagg->quantile[f*AGGQUANTILES + j], quantilep[j]);
+
+	return 0;
+}
+
+void AGGfree(pwraggregate *pagg)
+{
+	free(pagg->value);
+	free(pagg->quantile);
+	free(pagg->reference);
+	pagg->value = pagg->angle = NULL;
+	pagg->quantile = NULL;
+	pagg->reference = NULL;
+}
+
+/** one finished job: r eigen values, and its r x n eigen vectors or NULL (jobs of a checkpoint) **/
+void AGGadd(pwraggregate *pagg, const double *eigenvalue, const double *eigenvector)
+{
+	int f, j, n = pagg->n;
+	const double *v;
+	double *w, cosine;
+
+	for (f = 0; f < pagg->r; f++) {
+		addmoments(&pagg->value[f], eigenvalue[f]);
+		for (j = 0; j < AGGQUANTILES; j++)
+			addquantile(&pagg->quantile[f*AGGQUANTILES + j], eigenvalue[f]);
+	}
+	if (eigenvector == NULL)
+		return;
+
+	if (!pagg->hasreference) {
+		memcpy(pagg->reference, eigenvector, (size_t)pagg->r*n*sizeof(double));
+		pagg->hasreference = 1;
+	}
+	for (f = 0; f < pagg->r; f++) {
+		v = &eigenvector[(size_t)f*n];
+		w = &pagg->reference[(size_t)f*n];
+		cosine = fabs(LINdot(n, (double *) v, w))/sqrt(LINdot(n, (double *) v, (double *) v)*LINdot(n, w, w));
+		addmoments(&pagg->angle[f], acos(cosine < 1 ? cosine : 1)*180/M_PI);
+	}
+}
+
+/** 1 once the stop rule is met **/
+int AGGdone(pwraggregate *pagg)
+{
+	return pagg->epsilon > 0 && pagg->value[0].count >= AGGMINJOBS && AGGwidth(&pagg->value[0]) < pagg->epsilon;
+}
+
+void AGGreport(pwraggregate *pagg)
+{
+	int f;
+	aggmoments *pvalue, *pangle;
+	aggquantile *pq;
+
+	if (pagg->value == NULL || pagg->value[0].count == 0)
+		return;
+	for (f = 0; f < pagg->r; f++) {
+		pvalue = &pagg->value[f];
+		pq = &pagg->quantile[f*AGGQUANTILES];
+		printf("aggregate: eigenvalue #%d over %ld jobs: mean %.12e sd %.6e 95%% CI width %.6e min %.12e p05 %.12e p50 %.12e p95 %.12e max %.12e\n",
+				f + 1, pvalue->count, pvalue->mean, deviation(pvalue), pvalue->count > 1 ? AGGwidth(pvalue) : 0,
+				pvalue->min, quantile(&pq[0]), quantile(&pq[1]), quantile(&pq[2]), pvalue->max);
+		pangle = &pagg->angle[f];
+		if (pangle->count > 0)
+			printf("aggregate: eigenvector #%d over %ld jobs: angle to the first job mean %.6f sd %.6f max %.6f degrees\n",
+					f + 1, pangle->count, pangle->mean, deviation(pangle), pangle->max);
+	}
+}
@@ -0,0 +1,58 @@
+#ifndef AGGREGATE
+#define AGGREGATE
+
+/** Statistics of the perturbed jobs, kept by the master as the results come in (one pass, O(r n)
+ * per job, nothing stored per job):
+ * - mean, variance (Welford), min and max of every eigen value
+ * - its 5%, 50% and 95% quantiles, estimated with the P^2 algorithm of Jain and Chlamtac (five
+ *   markers per quantile, exact up to five jobs)
+ * - the angle, in degrees, between every eigen vector and the one of the first job aggregated,
+ *   with the same moments; the sign of a vector is arbitrary and does not count
+ * With -E epsilon the run stops once the 95% confidence interval on the top eigen value (normal
+ * approximation, after AGGMINJOBS jobs) is narrower than epsilon: the batches still queued are
+ * dropped, those running finish. A checkpoint keeps the dropped jobs pending.
+ * Interrupted jobs are left out.
+ * **/
+
+#define AGGQUANTILES 3
+#define AGGMINJOBS 20 /** jobs before the stop rule is trusted **/
+#define AGGZ95 1.959963984540054
+
+typedef struct aggmoments{
+	long count;
+	double mean;
+	double m2; /** sum of the squared deviations from the mean **/
+	double min;
+	double max;
+}aggmoments;
+
+/** P^2 estimate of one quantile **/
+typedef struct aggquantile{
+	double p;
+	int count;
+	double height[5]; /** marker heights, the first count observations sorted until count is 5 **/
+	double position[5]; /** actual marker positions, from 1 **/
+	double desired[5];
+	double increment[5];
+}aggquantile;
+
+typedef struct pwraggregate{
+	int n;
+	int r;
+	aggmoments *value; /** r **/
+	aggquantile *quantile; /** r x AGGQUANTILES **/
+	aggmoments *angle; /** r **/
+	double *reference; /** r x n eigen vectors of the first job, once hasreference **/
+	int hasreference;
+	double epsilon; /** width of the interval that stops the run, 0 for no stop rule **/
+	int stopped; /** the stop rule was met **/
+}pwraggregate;
+
+int AGGinit(pwraggregate *pagg, int n, int r, double epsilon);
+void AGGfree(pwraggregate *pagg);
+void AGGadd(pwraggregate *pagg, const double *eigenvalue, const double *eigenvector);
+double AGGwidth(aggmoments *pmoments);
+int AGGdone(pwraggregate *pagg);
+void AGGreport(pwraggregate *pagg);
+
+#endif
@@ -0,0 +1,79 @@
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include "utilities.h"
+#include "power.h"
+#include "arena.h"
+
+static const char *pagesname[3] = {"small", "transparent huge", "explicit huge"};
+
+/** offset of a new buffer of the given size, the arena must not be mapped yet **/
+size_t PWRarenaslot(pwrarena *parena, size_t bytes)
+{
+	size_t offset = parena->size;
+
+	parena->size += (bytes + ARENAALIGN - 1)/ARENAALIGN*ARENAALIGN;
+
+	return offset;
+}
+
+/** maps the layout, zeroed; returns NOMEMORY if there is no room **/
+int PWRarenamap(pwrarena *parena)
+{
+	size_t bytes = parena->size > 0 ? parena->size : ARENAALIGN;
+	uintptr_t start;
+	void *address;
+
+	if (bytes >= ARENAHUGEPAGE) {
+		/** fails at once when no huge page is reserved (vm.nr_hugepages) **/
+		parena->mapped = (bytes + ARENAHUGEPAGE - 1)/ARENAHUGEPAGE*ARENAHUGEPAGE;
+		address = mmap(NULL, parena->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (address != MAP_FAILED) {
+			parena->mapping = address;
+			parena->base = (char *) address;
+			parena->pages = ARENAHUGETLB;
+			return 0;
+		}
+
+		/** a huge page only backs a huge page aligned range: map one more and start inside **/
+		parena->mapped += ARENAHUGEPAGE;
+		address = mmap(NULL, parena->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (address == MAP_FAILED)
+			return NOMEMORY;
+		start = ((uintptr_t) address + ARENAHUGEPAGE - 1)/ARENAHUGEPAGE*ARENAHUGEPAGE;
+		parena->mapping = address;
+		parena->base = (char *) start;
+		parena->pages = madvise(parena->base, parena->mapped - ARENAHUGEPAGE, MADV_HUGEPAGE) == 0 ? ARENATRANSPARENT : ARENASMALL;
+		return 0;
+	}
+
+	parena->mapped = bytes;
+	address = mmap(NULL, parena->mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (address == MAP_FAILED)
+		return NOMEMORY;
+	parena->mapping = address;
+	parena->base = (char *) address;
+	parena->pages = ARENASMALL;
+
+	return 0;
+}
+
+void *PWRarenaat(pwrarena *parena, size_t offset)
+{
+	return parena->base + offset;
+}
+
+/** every buffer at once, the layout is kept **/
+void PWRarenafree(pwrarena *parena)
+{
+	if (parena->mapping != NULL)
+		munmap(parena->mapping, parena->mapped);
+	parena->mapping = NULL;
+	parena->base = NULL;
+	parena->mapped = 0;
+}
+
+const char *PWRarenapagesname(int pages)
+{
+	return pagesname[pages];
+}
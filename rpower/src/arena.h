@@ -0,0 +1,35 @@
+#ifndef ARENA
+#define ARENA
+
+#include <stddef.h>
+
+/** Per worker arena: all the buffers of a bag in one zeroed mapping, each at a fixed offset that
+ * is a multiple of ARENAALIGN (a cache line, and a full AVX-512 vector). The layout is made first
+ * with PWRarenaslot, then PWRarenamap maps it once: with explicit huge pages (MAP_HUGETLB) when
+ * the system has some reserved, else with transparent huge pages asked for by madvise on a huge
+ * page aligned range, and small pages for an arena under ARENAHUGEPAGE. The bag keeps it for all
+ * its jobs and PWRarenafree releases everything at once.
+ * **/
+
+#define ARENAALIGN 64
+#define ARENAHUGEPAGE ((size_t)2 << 20)
+
+#define ARENASMALL 0 /** normal pages **/
+#define ARENATRANSPARENT 1 /** madvise(MADV_HUGEPAGE), the kernel may or may not back it with huge pages **/
+#define ARENAHUGETLB 2 /** reserved huge pages **/
+
+typedef struct pwrarena{
+	size_t size; /** bytes laid out **/
+	char *base; /** start of the buffers, NULL until mapped **/
+	void *mapping; /** what mmap returned, base is in it **/
+	size_t mapped; /** its length **/
+	int pages; /** ARENASMALL, ARENATRANSPARENT or ARENAHUGETLB **/
+}pwrarena;
+
+size_t PWRarenaslot(pwrarena *parena, size_t bytes);
+int PWRarenamap(pwrarena *parena);
+void *PWRarenaat(pwrarena *parena, size_t offset);
+void PWRarenafree(pwrarena *parena);
+const char *PWRarenapagesname(int pages);
+
+#endif
@@ -0,0 +1,138 @@
+#include <pthread.h>
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "linalg.h"
+#include "team.h"
+
+/** Batched power method: a worker advances all the jobs of its batch together.
+ * The jobs only differ by their rank 1 perturbation (and later their deflated pairs), so one
+ * product of the shared base matrix with the block of current iterates serves every job, and
+ * each job then applies its own O(n) corrections (OPcorrect).
+ * A job that converges on its last eigen pair leaves the block, so the block shrinks
+ * as jobs retire and a slow job does not make the others iterate.
+ * **/
+
+/** returns 1 if the batch was interrupted **/
+int PWRbatchpower(powerbag *pbag)
+{
+	int n, r, ID, k, p, b, f, nactive, refined;
+	int *slot, *level;
+	double *x, *y, *xp, *yp, *swap, *vector, *vector0, *eigenvalue;
+	double norm2, mult, error, maxerror, tolerance;
+	int interrupting = 0;
+
+	ID = pbag->ID;
+	n = pbag->n;
+	r = pbag->r;
+	tolerance = pbag->tolerance;
+	x = pbag->blockx;
+	y = pbag->blocky;
+	slot = pbag->batchslot;
+	level = pbag->batchlevel;
+	nactive = pbag->batchcount;
+
+	for (b = 0; b < nactive; b++) {
+		OPinit(&pbag->batchop[b], n, pbag->qcopy, &pbag->scratch[b*n], &pbag->eigenvalue[b*r], &pbag->vector[(size_t)b*r*n]);
+		pbag->batchop[b].pteam = pbag->pteam;
+		OPfactor(&pbag->batchop[b], pbag->factor, pbag->factorwork);
+		OPstream(&pbag->batchop[b], pbag->stream);
+		slot[b] = b;
+		level[b] = 0;
+		pbag->iterations[b] = 0;
+		pbag->refined[b] = 0;
+		pbag->lowbest[b] = HUGE_VAL;
+		pbag->lowstall[b] = 0;
+		memcpy(&x[(size_t)b*n], &pbag->vector0[(size_t)b*r*n], n*sizeof(double));
+	}
+
+	for (k = 0; nactive > 0; k++) {
+		/** Y = Q0 X, one sweep over Q0 for all the active jobs, in low precision if asked for **/
+		if (pbag->factor != NULL)
+			FACsymm(pbag->factor, nactive, x, y, pbag->factorwork);
+		else if (pbag->stream != NULL)
+			PWRstreamsymm(pbag->stream, nactive, x, y);
+		else
+			PWRteamsymm(pbag->pteam, n, nactive, pbag->precision, pbag->precision == PRECDOUBLE ? pbag->qcopy : pbag->lowmatrix, x, y, NULL, NULL);
+
+		/** going down so that a retired row can be replaced by the last one, already processed **/
+		maxerror = 0;
+		for (p = nactive - 1; p >= 0; p--) {
+			b = slot[p];
+			f = level[b];
+			xp = &x[(size_t)p*n];
+			yp = &y[(size_t)p*n];
+			vector = &pbag->vector[(size_t)b*r*n];
+			vector0 = &pbag->vector0[(size_t)b*r*n];
+			eigenvalue = &pbag->eigenvalue[b*r];
+
+			OPcorrect(&pbag->batchop[b], xp, yp);
+			norm2 = LINdot(n, yp, yp);
+			mult = 1.0/sqrt(norm2);
+			eigenvalue[f] = 1.0/mult;
+			error = KRNscale_error(n, mult, yp, xp);
+			++pbag->iterations[b];
+			if (error > maxerror)
+				maxerror = error;
+
+			if (pbag->precision != PRECDOUBLE) {
+				if (!PWRlowphasedone(error, tolerance, &pbag->lowbest[b], &pbag->lowstall[b]))
+					continue;
+				/** this job alone goes on with the double matrix, xp is free once yp is computed **/
+				refined = PWRrefine(pbag, &pbag->batchop[b], yp, xp, &eigenvalue[f], &error);
+				pbag->iterations[b] += refined;
+				pbag->refined[b] += refined;
+				pbag->lowbest[b] = HUGE_VAL;
+				pbag->lowstall[b] = 0;
+			}
+
+			if (error >= tolerance)
+				continue;
+
+			/** finished to compute f-th eigen value of this job **/
+			memcpy(&vector[f*n], yp, n*sizeof(double));
+			/** Set Q' = Q' - lambda w w^T **/
+			pbag->batchop[b].ndeflated = f + 1;
+
+			pthread_mutex_lock(pbag->poutputmutex);
+			printf(" ID %d converged to tolerance %g! on job %d at iteration %d\n", ID, tolerance, pbag->jobnumber + b, k);
+			printf(" ID %d %d-th eigenvalue:  %g!\n", ID, f, eigenvalue[f]);
+			pthread_mutex_unlock(pbag->poutputmutex);
+
+			if (f < r-1) {
+				if (!pbag->warm)
+					PWRnextstart(n, f, vector, vector0);
+				memcpy(yp, &vector0[(f+1)*n], n*sizeof(double));
+				level[b] = f + 1;
+			}
+			else {
+				/** job done, its row is taken by the last active one **/
+				--nactive;
+				if (p != nactive) {
+					memcpy(yp, &y[(size_t)nactive*n], n*sizeof(double));
+					slot[p] = slot[nactive];
+				}
+			}
+		}
+
+		/** the new iterates become the current ones **/
+		swap = x; x = y; y = swap;
+
+		if(0 == k%100){
+			pthread_mutex_lock(pbag->poutputmutex);
+			printf("ID %d at batch iteration %d, %d of %d jobs active\n", ID, k, nactive, pbag->batchcount);
+			pthread_mutex_unlock(pbag->poutputmutex);
+		}
+
+		if (nactive > 0 && (interrupting = PWRcheckinterrupt(pbag, k, maxerror))) {
+			/** keep the partially converged iterates **/
+			for (p = 0; p < nactive; p++) {
+				b = slot[p];
+				memcpy(&pbag->vector[(size_t)b*r*n + level[b]*n], &x[(size_t)p*n], n*sizeof(double));
+			}
+			break;
+		}
+	}
+
+	return interrupting;
+}
@@ -0,0 +1,193 @@
+#include <errno.h>
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "matio.h"
+#include "checkpoint.h"
+
+/** all the jobs pending, the matrix (count doubles, packed or a factor model) is identified by its checksum **/
+int PWRckpinit(pwrcheckpoint *pckp, int n, int r, int quantity, double scale, unsigned int seed, const double *matrix, size_t count)
+{
+	int retcode = 0;
+
+	memset(pckp, 0, sizeof(pwrcheckpoint));
+	pckp->n = n;
+	pckp->r = r;
+	pckp->quantity = quantity;
+	pckp->scale = scale;
+	pckp->runseed = seed;
+	pckp->matrixchecksum = PWRchecksum(MATCHECKSUMSEED, matrix, count*sizeof(double));
+	pckp->status = (int *)calloc(3*(size_t)quantity, sizeof(int));
+	pckp->seed = (unsigned int *)calloc(quantity, sizeof(unsigned int));
+	pckp->eigenvalue = (double *)calloc((size_t)quantity*r, sizeof(double));
+	pckp->state = (double **)calloc(quantity, sizeof(double *));
+	if (!pckp->status || !pckp->seed || !pckp->eigenvalue || !pckp->state) {
+		PWRckpfree(pckp);
+		retcode = NOMEMORY; goto BACK;
+	}
+	pckp->iterations = &pckp->status[quantity];
+	pckp->matvecs = &pckp->status[2*(size_t)quantity];
+	pckp->lastwrite = PWRseconds();
+
+	BACK:
+	return retcode;
+}
+
+/** a missing file is a first run: returns 0 with every job pending **/
+int PWRckpload(pwrcheckpoint *pckp, char *filename)
+{
+	int retcode = 0, r = pckp->r, n = pckp->n;
+	uint32_t k;
+	FILE *input;
+	pwrckpheader header;
+	pwrckprecord record;
+	double *state;
+
+	if ((input = fopen(filename, "rb")) == NULL) {
+		if (errno == ENOENT)
+			return 0;
+		printf("cannot open checkpoint %s\n", filename);
+		return 1;
+	}
+
+	if (fread(&header, sizeof(header), 1, input) != 1 || memcmp(header.magic, CKPMAGIC, sizeof(header.magic))
+			|| header.version != CKPVERSION || header.byteorder != MATBYTEORDER) {
+		printf("%s is not a checkpoint of this version and byte order\n", filename); retcode = 1; goto BACK;
+	}
+	if (header.n != (uint32_t) n || header.r != (uint32_t) r || header.quantity != (uint32_t) pckp->quantity
+			|| header.scale != pckp->scale || header.seed != pckp->runseed || header.matrixchecksum != pckp->matrixchecksum) {
+		printf("%s was written for another run (n %u, r %u, quantity %u, scale %g, seed %u, or another matrix)\n", filename,
+				header.n, header.r, header.quantity, header.scale, header.seed);
+		retcode = 1; goto BACK;
+	}
+
+	for (k = 0; k < header.records; k++) {
+		if (fread(&record, sizeof(record), 1, input) != 1 || record.jobnumber >= (uint32_t) pckp->quantity
+				|| (record.status != JOBDONE && record.status != JOBINTERRUPTED)
+				|| fread(&pckp->eigenvalue[(size_t)record.jobnumber*r], sizeof(double), r, input) != (size_t) r) {
+			printf("%s is truncated or corrupted\n", filename); retcode = 1; goto BACK;
+		}
+		pckp->status[record.jobnumber] = record.status;
+		pckp->seed[record.jobnumber] = record.seed;
+		pckp->iterations[record.jobnumber] = record.iterations;
+		pckp->matvecs[record.jobnumber] = record.matvecs;
+		if (record.status == JOBINTERRUPTED) {
+			state = (double *)malloc((n + (size_t)r*n)*sizeof(double));
+			if (state == NULL) {
+				retcode = NOMEMORY; goto BACK;
+			}
+			free(pckp->state[record.jobnumber]);
+			pckp->state[record.jobnumber] = state;
+			if (fread(state, sizeof(double), n + (size_t)r*n, input) != n + (size_t)r*n) {
+				printf("%s is truncated or corrupted\n", filename); retcode = 1; goto BACK;
+			}
+		}
+	}
+
+	BACK:
+	fclose(input);
+	return retcode;
+}
+
+/** the jobs of a result are done, or interrupted with the iterates they had reached **/
+int PWRckprecord(pwrcheckpoint *pckp, powerresult *presult)
+{
+	int b, j, n = pckp->n, r = pckp->r;
+	size_t statesize = n + (size_t)r*n;
+
+	for (b = 0; b < presult->count; b++) {
+		j = presult->jobnumber + b;
+		pckp->seed[j] = presult->seed[b];
+		pckp->iterations[j] += presult->iterations[b];
+		pckp->matvecs[j] += presult->matvecs[b];
+		memcpy(&pckp->eigenvalue[(size_t)j*r], &presult->eigenvalue[b*r], r*sizeof(double));
+		if (presult->interrupted) {
+			if (pckp->state[j] == NULL && (pckp->state[j] = (double *)malloc(statesize*sizeof(double))) == NULL)
+				return NOMEMORY;
+			memcpy(pckp->state[j], &presult->perturbation[(size_t)b*n], n*sizeof(double));
+			memcpy(&pckp->state[j][n], &presult->eigenvector[(size_t)b*r*n], (size_t)r*n*sizeof(double));
+			pckp->status[j] = JOBINTERRUPTED;
+		}
+		else {
+			free(pckp->state[j]);
+			pckp->state[j] = NULL;
+			pckp->status[j] = JOBDONE;
+		}
+	}
+
+	return 0;
+}
+
+/** written next to the file then renamed over it, so that a crash leaves the previous checkpoint **/
+int PWRckpwrite(pwrcheckpoint *pckp, char *filename)
+{
+	int retcode = 0, j, n = pckp->n, r = pckp->r;
+	FILE *output = NULL;
+	char *temporary = NULL;
+	pwrckpheader header;
+	pwrckprecord record;
+
+	temporary = (char *)malloc(strlen(filename) + 5);
+	if (temporary == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	sprintf(temporary, "%s.tmp", filename);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, CKPMAGIC, sizeof(header.magic));
+	header.version = CKPVERSION;
+	header.byteorder = MATBYTEORDER;
+	header.n = n;
+	header.r = r;
+	header.quantity = pckp->quantity;
+	header.scale = pckp->scale;
+	header.seed = pckp->runseed;
+	header.matrixchecksum = pckp->matrixchecksum;
+	for (j = 0; j < pckp->quantity; j++)
+		header.records += pckp->status[j] != JOBPENDING;
+
+	if ((output = fopen(temporary, "wb")) == NULL) {
+		printf("cannot open checkpoint %s\n", temporary); retcode = 1; goto BACK;
+	}
+	if (fwrite(&header, sizeof(header), 1, output) != 1)
+		retcode = 1;
+	for (j = 0; j < pckp->quantity && retcode == 0; j++) {
+		if (pckp->status[j] == JOBPENDING)
+			continue;
+		memset(&record, 0, sizeof(record));
+		record.jobnumber = j;
+		record.status = pckp->status[j];
+		record.seed = pckp->seed[j];
+		record.iterations = pckp->iterations[j];
+		record.matvecs = pckp->matvecs[j];
+		if (fwrite(&record, sizeof(record), 1, output) != 1
+				|| fwrite(&pckp->eigenvalue[(size_t)j*r], sizeof(double), r, output) != (size_t) r
+				|| (pckp->status[j] == JOBINTERRUPTED
+					&& fwrite(pckp->state[j], sizeof(double), n + (size_t)r*n, output) != n + (size_t)r*n))
+			retcode = 1;
+	}
+	if (fclose(output) && retcode == 0)
+		retcode = 1;
+	if (retcode == 0 && rename(temporary, filename))
+		retcode = 1;
+	if (retcode)
+		printf("cannot write checkpoint %s\n", filename);
+	pckp->lastwrite = PWRseconds();
+
+	BACK:
+	free(temporary);
+	return retcode;
+}
+
+void PWRckpfree(pwrcheckpoint *pckp)
+{
+	int j;
+
+	for (j = 0; pckp->state != NULL && j < pckp->quantity; j++)
+		free(pckp->state[j]);
+	free(pckp->state);
+	free(pckp->status);
+	free(pckp->seed);
+	free(pckp->eigenvalue);
+	memset(pckp, 0, sizeof(pwrcheckpoint));
+}
@@ -0,0 +1,73 @@
+#ifndef CHECKPOINT
+#define CHECKPOINT
+
+#include <stdint.h>
+#include "power.h"
+
+/** Checkpoint of a run (-C file): which jobs are done, with their eigen values, and the state of
+ * the interrupted ones (by SIGINT or the iteration cap): their perturbation s and their r current
+ * iterates, converged pairs included. The master writes it every -I seconds from the results it
+ * has received, and once more at the end of the run. A run started with an existing checkpoint
+ * of the same matrix, n, r, scale, quantity and seed (-g) reports the done jobs as they are,
+ * continues the interrupted ones from their iterates (a warm start) and runs the others. The
+ * numbers of a job only depend on the seed and its job number (random.h), so the jobs that never
+ * started get the perturbations the first run would have drawn for them.
+ * File layout, native byte order like the matrix files of matio.h:
+ *   pwrckpheader
+ *   then for every done or interrupted job: pwrckprecord, r eigen values, and for an interrupted
+ *   job the n entries of its perturbation and its r x n iterates
+ * **/
+
+#define CKPMAGIC "RPWRCKP" /** 8 bytes with the terminating 0 **/
+#define CKPVERSION 2 /** 2 has the seed of the run **/
+#define CKPINTERVAL 60.0 /** default seconds between two writes **/
+
+/** status of a job **/
+#define JOBPENDING 0
+#define JOBDONE 1
+#define JOBINTERRUPTED 2
+
+typedef struct pwrckpheader{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder; /** MATBYTEORDER **/
+	uint32_t n;
+	uint32_t r;
+	uint32_t quantity;
+	uint32_t records;
+	uint32_t seed; /** of the run, see random.h **/
+	uint32_t reserved;
+	double scale;
+	uint64_t matrixchecksum; /** PWRchecksum of the packed matrix **/
+}pwrckpheader;
+
+typedef struct pwrckprecord{
+	uint32_t jobnumber;
+	uint32_t status;
+	uint32_t seed;
+	uint32_t iterations; /** over all the runs of the job **/
+	uint32_t matvecs;
+	uint32_t reserved;
+}pwrckprecord;
+
+typedef struct pwrcheckpoint{
+	int n, r, quantity;
+	double scale;
+	unsigned int runseed;
+	uint64_t matrixchecksum;
+	int *status; /** quantity entries **/
+	unsigned int *seed;
+	int *iterations;
+	int *matvecs;
+	double *eigenvalue; /** quantity x r **/
+	double **state; /** perturbation then r x n iterates of every interrupted job, NULL for the others **/
+	double lastwrite; /** PWRseconds **/
+}pwrcheckpoint;
+
+int PWRckpinit(pwrcheckpoint *pckp, int n, int r, int quantity, double scale, unsigned int seed, const double *matrix, size_t count);
+int PWRckpload(pwrcheckpoint *pckp, char *filename);
+int PWRckprecord(pwrcheckpoint *pckp, powerresult *presult);
+int PWRckpwrite(pwrcheckpoint *pckp, char *filename);
+void PWRckpfree(pwrcheckpoint *pckp);
+
+#endif
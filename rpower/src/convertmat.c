@@ -0,0 +1,57 @@
+#include "utilities.h"
+#include "kernels.h"
+#include "matio.h"
+#include "factor.h"
+
+/** Converts a covariance file to the binary format of matio.h, which rpower maps instead of parsing.
+ * The input is read with PWRreadnload, so it is validated on the way and may itself be binary;
+ * a returns file is converted to its covariance. With -r the returns are kept as they are and
+ * written as a binary returns file instead. A factor model stays a factor model (factor.h).
+ * usage: convertmat [-r] input output
+ * **/
+
+int main(int argc, char *argv[])
+{
+	int retcode = 0, n = 0, T = 0, k = 0, keepreturns;
+	double *matrix = NULL, *returns = NULL, *factors = NULL, start, read;
+
+	keepreturns = argc == 4 && !strcmp(argv[1], "-r");
+	if (argc != 3 && !keepreturns) {
+		printf(" usage: convertmat [-r] input output\n");
+		retcode = 1; goto BACK;
+	}
+
+	start = PWRseconds();
+	if (keepreturns) {
+		if ((retcode = PWRreadreturns(argv[2], &T, &n, &returns)))
+			goto BACK;
+		read = PWRseconds();
+		if ((retcode = PWRwritereturns(argv[3], T, n, returns)))
+			goto BACK;
+		printf("converted %s to %s: %d x %d returns, %.1f MB, read in %.3f s, written in %.3f s\n", argv[2], argv[3], T, n,
+				(size_t)T*n*sizeof(double)/1048576.0, read - start, PWRseconds() - read);
+		goto BACK;
+	}
+
+	if ((retcode = PWRreadmodel(argv[1], &n, &matrix, &k, &factors)))
+		goto BACK;
+	read = PWRseconds();
+	if (factors != NULL) {
+		if ((retcode = PWRwritefactors(argv[2], n, k, factors)))
+			goto BACK;
+		printf("converted %s to %s: factor model n = %d, k = %d, %.1f MB, read in %.3f s, written in %.3f s\n", argv[1], argv[2], n, k,
+				FACcount(n, k)*sizeof(double)/1048576.0, read - start, PWRseconds() - read);
+		goto BACK;
+	}
+	if ((retcode = PWRwritebinary(argv[2], n, matrix)))
+		goto BACK;
+
+	printf("converted %s to %s: n = %d, %.1f MB of packed data, read in %.3f s, written in %.3f s\n", argv[1], argv[2], n,
+			KRNpackedsize(n)*sizeof(double)/1048576.0, read - start, PWRseconds() - read);
+
+	BACK:
+	free(returns);
+	PWRfreematrix(&matrix, KRNpackedsize(n));
+	PWRfreematrix(&factors, FACcount(n, k));
+	return retcode;
+}
@@ -0,0 +1,152 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "matio.h"
+#include "covariance.h"
+
+typedef struct covorder{
+	int ID, numthreads;
+	int T, n;
+	double *returns;
+	double *mean; /** n column means, each thread fills its own range **/
+	double *matrix; /** packed upper triangle **/
+	double tile[COVTILE*COVTILE];
+}covorder;
+
+/** thread ID demeans the columns of its own range **/
+static void *center(void *pvoidedorder)
+{
+	covorder *porder = (covorder *) pvoidedorder;
+	int T = porder->T, n = porder->n, t, j;
+	int begin = (int)((long)n*porder->ID/porder->numthreads), end = (int)((long)n*(porder->ID + 1)/porder->numthreads);
+	double *mean = porder->mean, *row;
+
+	for (j = begin; j < end; j++)
+		mean[j] = 0;
+	for (t = 0; t < T; t++) {
+		row = &porder->returns[(size_t)t*n];
+		for (j = begin; j < end; j++)
+			mean[j] += row[j];
+	}
+	for (j = begin; j < end; j++)
+		mean[j] /= T;
+	for (t = 0; t < T; t++) {
+		row = &porder->returns[(size_t)t*n];
+		for (j = begin; j < end; j++)
+			row[j] -= mean[j];
+	}
+
+	return NULL;
+}
+
+/** tile (I, J), I <= J: rows I*COVTILE.. of C restricted to the columns J*COVTILE.., accumulated
+ * one observation at a time; on the diagonal only the upper half is computed
+ * **/
+static void producttile(covorder *porder, int I, int J)
+{
+	int T = porder->T, n = porder->n, t, a, b, bstart;
+	int i0 = I*COVTILE, j0 = J*COVTILE;
+	int ni = n - i0 < COVTILE ? n - i0 : COVTILE, nj = n - j0 < COVTILE ? n - j0 : COVTILE;
+	double *tile = porder->tile, *acc, *xi, *xj, v, scale = 1.0/(T - 1);
+
+	memset(tile, 0, sizeof(porder->tile));
+	for (t = 0; t < T; t++) {
+		xi = &porder->returns[(size_t)t*n + i0];
+		xj = &porder->returns[(size_t)t*n + j0];
+		for (a = 0; a < ni; a++) {
+			v = xi[a];
+			acc = &tile[a*COVTILE];
+			bstart = I == J ? a : 0;
+			for (b = bstart; b < nj; b++)
+				acc[b] += v*xj[b];
+		}
+	}
+
+	for (a = 0; a < ni; a++) {
+		bstart = I == J ? a : 0;
+		acc = &porder->matrix[KRNrowoffset(n, i0 + a) + j0 - (i0 + a)];
+		for (b = bstart; b < nj; b++)
+			acc[b] = scale*tile[a*COVTILE + b];
+	}
+}
+
+/** the tiles of the upper triangle in row order, thread ID takes every numthreads-th one **/
+static void *product(void *pvoidedorder)
+{
+	covorder *porder = (covorder *) pvoidedorder;
+	int tiles = (porder->n + COVTILE - 1)/COVTILE, I, J;
+	long k = 0;
+
+	for (I = 0; I < tiles; I++)
+		for (J = I; J < tiles; J++, k++)
+			if (k % porder->numthreads == porder->ID)
+				producttile(porder, I, J);
+
+	return NULL;
+}
+
+/** The returns are demeaned in place. *pmatrix receives the packed covariance in PWRallocmatrix
+ * storage, sealed read only like the matrices of PWRreadnload. numthreads <= 0 means one thread
+ * per online processor.
+ * **/
+int PWRcovariance(int T, int n, double *returns, int numthreads, double **pmatrix)
+{
+	int retcode = 0, t, tiles = (n + COVTILE - 1)/COVTILE;
+	double *matrix = NULL, *mean = NULL, start = PWRseconds();
+	covorder *orders = NULL;
+	pthread_t *threads = NULL;
+
+	if (T < 2 || n < 1) {
+		printf("a covariance needs at least 2 observations of 1 asset, got %d x %d returns\n", T, n);
+		retcode = 1; goto BACK;
+	}
+	if (numthreads <= 0)
+		numthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (numthreads > tiles*(tiles + 1)/2)
+		numthreads = tiles*(tiles + 1)/2;
+	if (numthreads < 1)
+		numthreads = 1;
+
+	matrix = PWRallocmatrix(KRNpackedsize(n));
+	mean = (double *)calloc(n, sizeof(double));
+	orders = (covorder *)calloc(numthreads, sizeof(covorder));
+	threads = (pthread_t *)calloc(numthreads, sizeof(pthread_t));
+	if (matrix == NULL || mean == NULL || orders == NULL || threads == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	for (t = 0; t < numthreads; t++) {
+		orders[t].ID = t;
+		orders[t].numthreads = numthreads;
+		orders[t].T = T;
+		orders[t].n = n;
+		orders[t].returns = returns;
+		orders[t].mean = mean;
+		orders[t].matrix = matrix;
+	}
+
+	for (t = 1; t < numthreads; t++)
+		pthread_create(&threads[t], NULL, &center, (void *) &orders[t]);
+	center((void *) &orders[0]);
+	for (t = 1; t < numthreads; t++)
+		pthread_join(threads[t], NULL);
+
+	for (t = 1; t < numthreads; t++)
+		pthread_create(&threads[t], NULL, &product, (void *) &orders[t]);
+	product((void *) &orders[0]);
+	for (t = 1; t < numthreads; t++)
+		pthread_join(threads[t], NULL);
+
+	PWRsealmatrix(matrix, KRNpackedsize(n));
+	printf("covariance of %d x %d returns computed with %d threads in %.6f s\n", T, n, numthreads, PWRseconds() - start);
+
+	BACK:
+	free(threads);
+	free(orders);
+	free(mean);
+	if (retcode != 0)
+		PWRfreematrix(&matrix, KRNpackedsize(n));
+	*pmatrix = matrix;
+	return retcode;
+}
@@ -0,0 +1,16 @@
+#ifndef COVARIANCE
+#define COVARIANCE
+
+/** Covariance of a T x n returns matrix (T observations of n assets, row major), built directly
+ * into the packed matrix the eigen solvers use: the columns are demeaned in place, then
+ * C = Xc' Xc/(T - 1) is computed as a symmetric rank T update over 64 x 64 tiles of the upper
+ * triangle, spread over the threads. A tile keeps its sums in a small local buffer while the
+ * rows of the two column blocks it needs stream by, so nothing of size n x n but the result is
+ * ever written.
+ * **/
+
+#define COVTILE 64
+
+int PWRcovariance(int T, int n, double *returns, int numthreads, double **pmatrix);
+
+#endif
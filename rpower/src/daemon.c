@@ -0,0 +1,430 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "matio.h"
+#include "daemon.h"
+
+int cheap_rank1perturb(int n, double *scratch, unsigned int seed, unsigned int job, double scale);
+
+/** one solve request of a client, its jobs are queued for the workers, which answer on replies **/
+typedef struct pwrrequest{
+	int matrix;
+	int quantity;
+	int r;
+	int vectors; /** 1 to send the eigen vectors too **/
+	double scale;
+	double tolerance;
+	unsigned int seed;
+	pwrqueue replies; /** one text per job, malloc'ed **/
+}pwrrequest;
+
+typedef struct pwrtask{
+	pwrrequest *prequest;
+	int jobnumber;
+}pwrtask;
+
+typedef struct pwrdaemon{
+	pwrservedmatrix *matrices;
+	int count;
+	powerconfig config;
+	pwrqueue jobs; /** pwrtask pointers, shared by all the clients **/
+	volatile sig_atomic_t *pstop;
+	pthread_mutex_t *poutputmutex;
+	pthread_mutex_t clientmutex;
+	pthread_cond_t clientgone;
+	int clientfd[DAEMONMAXCLIENTS]; /** -1 for a free slot **/
+	int clients;
+	volatile int quitting;
+}pwrdaemon;
+
+typedef struct daemonthread{
+	pwrdaemon *pdaemon;
+	int ID; /** worker ID, or client slot **/
+	int fd;
+}daemonthread;
+
+/** what a job answers when its text could not be allocated **/
+static char nomemory[] = "error no memory for the result\n";
+
+static int sendtext(int fd, const char *text)
+{
+	size_t length = strlen(text);
+	ssize_t sent;
+
+	while (length > 0) {
+		sent = send(fd, text, length, MSG_NOSIGNAL);
+		if (sent <= 0)
+			return 1;
+		text += sent;
+		length -= sent;
+	}
+
+	return 0;
+}
+
+/** the answer of a finished job, see daemon.h **/
+static char *formatreply(powerbag *pbag, pwrrequest *prequest, int interrupted)
+{
+	int n = pbag->n, r = pbag->r, f, j;
+	size_t size = 128 + 26*(size_t)r, used;
+	char *text;
+
+	if (prequest->vectors)
+		size += (size_t)r*(32 + 26*(size_t)n);
+	if ((text = (char *)malloc(size)) == NULL)
+		return NULL;
+
+	used = snprintf(text, size, "job %d worker %d iterations %d matvecs %d%s eigenvalues", pbag->jobnumber, pbag->ID,
+			pbag->iterations[0], pbag->matvecs[0], interrupted ? " interrupted" : "");
+	for (f = 0; f < r; f++)
+		used += snprintf(&text[used], size - used, " %.12e", pbag->eigenvalue[f]);
+	used += snprintf(&text[used], size - used, "\n");
+	for (f = 0; prequest->vectors && f < r; f++) {
+		used += snprintf(&text[used], size - used, "vector %d %d", pbag->jobnumber, f);
+		for (j = 0; j < n; j++)
+			used += snprintf(&text[used], size - used, " %.12e", pbag->vector[(size_t)f*n + j]);
+		used += snprintf(&text[used], size - used, "\n");
+	}
+
+	return text;
+}
+
+/** worker: runs queued jobs of any request; its bag is kept while the matrix and r stay the same **/
+static void *worker(void *pvoided)
+{
+	daemonthread *pthread = (daemonthread *) pvoided;
+	pwrdaemon *pdaemon = pthread->pdaemon;
+	powerconfig config = pdaemon->config;
+	powerbag *pbag = NULL;
+	pwrtask *ptask;
+	pwrrequest *prequest;
+	pwrservedmatrix *pmatrix;
+	int bagmatrix = -1, interrupted;
+	char *reply;
+
+	while ((ptask = (pwrtask *) PWRqueuepop(&pdaemon->jobs)) != NULL) {
+		prequest = ptask->prequest;
+		pmatrix = &pdaemon->matrices[prequest->matrix];
+		if (pbag == NULL || bagmatrix != prequest->matrix || pbag->r != prequest->r) {
+			PWRfreebag(&pbag);
+			bagmatrix = -1;
+			config.r = prequest->r;
+			config.lowmatrix = pmatrix->lowmatrix;
+			if (PWRallocatebag(pthread->ID, pmatrix->n, pmatrix->matrix, &config, &pbag, NULL, NULL, pdaemon->pstop, pdaemon->poutputmutex)) {
+				PWRqueuepush(&prequest->replies, nomemory);
+				continue;
+			}
+			bagmatrix = prequest->matrix;
+		}
+
+		pbag->scale = prequest->scale;
+		pbag->tolerance = prequest->tolerance;
+		pbag->jobnumber = ptask->jobnumber;
+		pbag->batchcount = 1;
+		pbag->itercount = 0;
+		pbag->warm = 0;
+		/** same draws as job j of the command line run with this seed (-g) **/
+		pbag->rseed = pbag->seed[0] = prequest->seed;
+		cheap_rank1perturb(pmatrix->n, pbag->scratch, prequest->seed, ptask->jobnumber, pbag->scale);
+		RNGuniform(prequest->seed, ptask->jobnumber, RNGSTART, 0, (size_t)pmatrix->n*(pbag->engine == ENGINESUBSPACE ? pbag->r : 1), pbag->vector0);
+
+		interrupted = PWRrunengine(pbag);
+		reply = formatreply(pbag, prequest, interrupted);
+		PWRqueuepush(&prequest->replies, reply != NULL ? reply : nomemory);
+	}
+
+	PWRfreebag(&pbag);
+	return NULL;
+}
+
+/** fills the request from "solve key value ...", the command line values being the defaults;
+ * returns a message for the client if the request is bad
+ * **/
+static const char *parsesolve(pwrdaemon *pdaemon, char *line, pwrrequest *prequest)
+{
+	char *key, *value, *save, *stop;
+	double number;
+
+	memset(prequest, 0, sizeof(pwrrequest));
+	prequest->quantity = 1;
+	prequest->r = pdaemon->config.r;
+	prequest->scale = pdaemon->config.scale;
+	prequest->tolerance = pdaemon->config.tolerance;
+	prequest->seed = pdaemon->config.seed;
+
+	strtok_r(line, " \t\r\n", &save); /** solve **/
+	while ((key = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+		value = strtok_r(NULL, " \t\r\n", &save);
+		if (value == NULL)
+			return "missing value";
+		number = strtod(value, &stop);
+		if (*stop != 0 || !isfinite(number))
+			return "bad value";
+		if (!strcmp(key, "matrix"))
+			prequest->matrix = (int) number;
+		else if (!strcmp(key, "scale"))
+			prequest->scale = number;
+		else if (!strcmp(key, "quantity"))
+			prequest->quantity = (int) number;
+		else if (!strcmp(key, "r"))
+			prequest->r = (int) number;
+		else if (!strcmp(key, "tolerance"))
+			prequest->tolerance = number;
+		else if (!strcmp(key, "seed"))
+			prequest->seed = (unsigned int) number;
+		else if (!strcmp(key, "vectors"))
+			prequest->vectors = number != 0;
+		else
+			return "unknown field";
+	}
+
+	if (prequest->matrix < 0 || prequest->matrix >= pdaemon->count)
+		return "no such matrix";
+	if (prequest->quantity < 1 || prequest->quantity > DAEMONMAXQUANTITY)
+		return "bad quantity";
+	if (prequest->r < 1 || prequest->r > pdaemon->matrices[prequest->matrix].n)
+		return "bad r";
+	if (prequest->tolerance <= 0)
+		return "bad tolerance";
+
+	return NULL;
+}
+
+/** queue the jobs of a request and send their answers as they come **/
+static int solve(pwrdaemon *pdaemon, int fd, pwrrequest *prequest)
+{
+	int retcode = 0, j, pushed, gone = 0;
+	pwrtask *tasks = NULL;
+	char *reply, text[128];
+	double start = PWRseconds();
+
+	tasks = (pwrtask *)calloc(prequest->quantity, sizeof(pwrtask));
+	if (tasks == NULL || PWRqueueinit(&prequest->replies, prequest->quantity, 1)) {
+		sendtext(fd, nomemory);
+		retcode = NOMEMORY; goto BACK;
+	}
+
+	for (pushed = 0; pushed < prequest->quantity; pushed++) {
+		tasks[pushed].prequest = prequest;
+		tasks[pushed].jobnumber = pushed;
+		if (PWRqueuepush(&pdaemon->jobs, &tasks[pushed]))
+			break;
+	}
+
+	/** every pushed job answers, even when the client is gone **/
+	for (j = 0; j < pushed; j++) {
+		reply = (char *) PWRqueuepop(&prequest->replies);
+		gone = gone || sendtext(fd, reply);
+		if (reply != nomemory)
+			free(reply);
+	}
+
+	if (pushed < prequest->quantity)
+		snprintf(text, sizeof(text), "error the server is stopping, %d of %d jobs run\n", pushed, prequest->quantity);
+	else
+		snprintf(text, sizeof(text), "done %d jobs %.6f s\n", pushed, PWRseconds() - start);
+	gone = gone || sendtext(fd, text);
+	retcode = gone;
+
+	BACK:
+	PWRqueuedestroy(&prequest->replies);
+	free(tasks);
+	return retcode;
+}
+
+/** one thread per connection, reading requests until the client hangs up or the server stops **/
+static void *client(void *pvoided)
+{
+	daemonthread *pthread = (daemonthread *) pvoided;
+	pwrdaemon *pdaemon = pthread->pdaemon;
+	FILE *input = NULL;
+	char line[DAEMONLINE], text[DAEMONLINE + 64], command[16];
+	const char *problem;
+	pwrrequest request;
+	int k, fd = pthread->fd;
+
+	input = fdopen(dup(fd), "r");
+	while (input != NULL && fgets(line, sizeof(line), input) != NULL) {
+		command[0] = 0;
+		sscanf(line, "%15s", command);
+		if (!strcmp(command, "solve")) {
+			if ((problem = parsesolve(pdaemon, line, &request)) != NULL) {
+				snprintf(text, sizeof(text), "error %s\n", problem);
+				sendtext(fd, text);
+			}
+			else if (solve(pdaemon, fd, &request))
+				break;
+		}
+		else if (!strcmp(command, "info")) {
+			for (k = 0; k < pdaemon->count; k++) {
+				snprintf(text, sizeof(text), "matrix %d n %d file %s\n", k, pdaemon->matrices[k].n, pdaemon->matrices[k].filename);
+				sendtext(fd, text);
+			}
+			sendtext(fd, "done\n");
+		}
+		else if (!strcmp(command, "quit")) {
+			pdaemon->quitting = 1;
+			sendtext(fd, "done\n");
+		}
+		else if (command[0] != 0)
+			sendtext(fd, "error unknown command\n");
+	}
+
+	if (input != NULL)
+		fclose(input);
+	close(fd);
+	pthread_mutex_lock(&pdaemon->clientmutex);
+	pdaemon->clientfd[pthread->ID] = -1;
+	--pdaemon->clients;
+	pthread_cond_signal(&pdaemon->clientgone);
+	pthread_mutex_unlock(&pdaemon->clientmutex);
+	free(pthread);
+
+	return NULL;
+}
+
+/** give a connection its thread, or turn it down when all the slots are taken **/
+static void admit(pwrdaemon *pdaemon, int fd)
+{
+	int slot;
+	daemonthread *pthread;
+	pthread_t thread;
+	pthread_attr_t attr;
+
+	pthread_mutex_lock(&pdaemon->clientmutex);
+	for (slot = 0; slot < DAEMONMAXCLIENTS && pdaemon->clientfd[slot] >= 0; slot++);
+	if (slot == DAEMONMAXCLIENTS || (pthread = (daemonthread *)calloc(1, sizeof(daemonthread))) == NULL) {
+		pthread_mutex_unlock(&pdaemon->clientmutex);
+		sendtext(fd, "error too many clients\n");
+		close(fd);
+		return;
+	}
+	pthread->pdaemon = pdaemon;
+	pthread->ID = slot;
+	pthread->fd = fd;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	if (pthread_create(&thread, &attr, &client, (void *) pthread)) {
+		free(pthread);
+		close(fd);
+	}
+	else {
+		pdaemon->clientfd[slot] = fd;
+		++pdaemon->clients;
+	}
+	pthread_attr_destroy(&attr);
+	pthread_mutex_unlock(&pdaemon->clientmutex);
+}
+
+/** Load the matrices, start the workers and serve until a client sends quit or SIGINT.
+ * Everything is set up once: the requests only queue jobs.
+ * **/
+int PWRserve(char *socketpath, char **filenames, int count, powerconfig *pconfig, int numworkers,
+		volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex)
+{
+	int retcode = 0, k, j, listenfd = -1, fd, started = 0;
+	pwrdaemon daemon;
+	pwrservedmatrix matrices[DAEMONMAXMATRICES];
+	daemonthread *workers = NULL;
+	pthread_t *threads = NULL;
+	struct sockaddr_un address;
+	struct pollfd waiting;
+
+	memset(&daemon, 0, sizeof(pwrdaemon));
+	memset(matrices, 0, sizeof(matrices));
+	pthread_mutex_init(&daemon.clientmutex, NULL);
+	pthread_cond_init(&daemon.clientgone, NULL);
+	for (k = 0; k < DAEMONMAXCLIENTS; k++)
+		daemon.clientfd[k] = -1;
+	daemon.matrices = matrices;
+	daemon.count = count;
+	daemon.config = *pconfig;
+	daemon.config.batch = 1;
+	daemon.config.teamsize = 1;
+	daemon.config.sharedmatrix = 1;
+	daemon.config.warmstart = WARMRANDOM;
+	daemon.config.basevector = NULL;
+	daemon.pstop = pstop;
+	daemon.poutputmutex = poutputmutex;
+
+	if (count > DAEMONMAXMATRICES) {
+		printf("at most %d matrices can be served\n", DAEMONMAXMATRICES); retcode = 1; goto BACK;
+	}
+	for (k = 0; k < count; k++) {
+		matrices[k].filename = filenames[k];
+		if ((retcode = PWRreadnload(filenames[k], &matrices[k].n, &matrices[k].matrix)))
+			goto BACK;
+		if (pconfig->precision != PRECDOUBLE
+				&& (matrices[k].lowmatrix = PWRlowermatrix(matrices[k].n, matrices[k].matrix, pconfig->precision)) == NULL) {
+			retcode = NOMEMORY; goto BACK;
+		}
+	}
+
+	if (strlen(socketpath) >= sizeof(address.sun_path)) {
+		printf("socket path %s is too long\n", socketpath); retcode = 1; goto BACK;
+	}
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, socketpath);
+	unlink(socketpath);
+	if ((listenfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 || bind(listenfd, (struct sockaddr *) &address, sizeof(address))
+			|| listen(listenfd, DAEMONMAXCLIENTS)) {
+		printf("cannot listen on %s\n", socketpath); retcode = 1; goto BACK;
+	}
+
+	workers = (daemonthread *)calloc(numworkers, sizeof(daemonthread));
+	threads = (pthread_t *)calloc(numworkers, sizeof(pthread_t));
+	if (workers == NULL || threads == NULL || PWRqueueinit(&daemon.jobs, DAEMONQUEUE, 1)) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	for (started = 0; started < numworkers; started++) {
+		workers[started].pdaemon = &daemon;
+		workers[started].ID = started;
+		if (pthread_create(&threads[started], NULL, &worker, (void *) &workers[started]))
+			break;
+	}
+	printf("serving %d matrices on %s with %d workers\n", count, socketpath, started);
+
+	waiting.fd = listenfd;
+	waiting.events = POLLIN;
+	while (!daemon.quitting && !*pstop) {
+		if (poll(&waiting, 1, 200) <= 0 || !(waiting.revents & POLLIN))
+			continue;
+		if ((fd = accept(listenfd, NULL, NULL)) >= 0)
+			admit(&daemon, fd);
+	}
+	printf("server stopping\n");
+
+	BACK:
+	if (listenfd >= 0) {
+		close(listenfd);
+		unlink(socketpath);
+	}
+	/** no more requests are read, those under way are answered **/
+	pthread_mutex_lock(&daemon.clientmutex);
+	for (k = 0; k < DAEMONMAXCLIENTS; k++)
+		if (daemon.clientfd[k] >= 0)
+			shutdown(daemon.clientfd[k], SHUT_RD);
+	while (daemon.clients > 0)
+		pthread_cond_wait(&daemon.clientgone, &daemon.clientmutex);
+	pthread_mutex_unlock(&daemon.clientmutex);
+	if (daemon.jobs.items != NULL)
+		PWRqueueclose(&daemon.jobs);
+	for (j = 0; j < started; j++)
+		pthread_join(threads[j], NULL);
+	PWRqueuedestroy(&daemon.jobs);
+	free(threads);
+	free(workers);
+	for (k = 0; k < count && k < DAEMONMAXMATRICES; k++) {
+		PWRfreematrix(&matrices[k].matrix, KRNpackedsize(matrices[k].n));
+		PWRfreematrix(&matrices[k].lowmatrix, PWRlowercount(matrices[k].n, pconfig->precision));
+	}
+	pthread_mutex_destroy(&daemon.clientmutex);
+	pthread_cond_destroy(&daemon.clientgone);
+	return retcode;
+}
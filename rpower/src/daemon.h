@@ -0,0 +1,40 @@
+#ifndef DAEMON
+#define DAEMON
+
+#include <signal.h>
+#include <pthread.h>
+#include "power.h"
+
+/** Server mode (rpower file -S socket [-M file ...]): the matrices are loaded once and the -w
+ * workers stay up between requests, keeping their bag as long as the matrix and r do not change.
+ * Clients connect to the Unix domain socket and send one request per line, each answered by
+ * lines of text:
+ *   solve [matrix k] [scale s] [quantity q] [r r] [tolerance t] [seed s] [vectors 0|1]
+ *     -> "job <j> worker <w> iterations <i> matvecs <m> eigenvalues <r values>" per job, in
+ *        completion order, followed with vectors 1 by "vector <j> <f> <n values>" for its r
+ *        eigen vectors, then "done <q> jobs <seconds> s"
+ *   info -> "matrix <k> n <n> file <name>" per matrix, then "done"
+ *   quit -> "done", the server stops once the requests under way are answered
+ * A bad request gets "error <reason>". Missing fields take the values of the command line.
+ * Job j of a request draws its perturbation and starting vectors from the streams of job j
+ * (random.h) with the seed of the request, -g by default: whichever worker runs it, a request
+ * gives the same answer every time, the same as job j of the command line with that seed.
+ * **/
+
+#define DAEMONQUEUE 4096 /** jobs waiting for a worker, a request pushing more waits for room **/
+#define DAEMONMAXCLIENTS 64
+#define DAEMONMAXQUANTITY 1000000
+#define DAEMONLINE 1024 /** longest request line **/
+#define DAEMONMAXMATRICES 16
+
+typedef struct pwrservedmatrix{
+	char *filename;
+	int n;
+	double *matrix; /** packed, sealed **/
+	double *lowmatrix; /** rounded copy, NULL for PRECDOUBLE **/
+}pwrservedmatrix;
+
+int PWRserve(char *socketpath, char **filenames, int count, powerconfig *pconfig, int numworkers,
+		volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex);
+
+#endif
@@ -0,0 +1,54 @@
+#include "utilities.h"
+#include "factor.h"
+
+/** factors is the block of FACcount(n, k) doubles from PWRreadmodel, the model points into it **/
+void FACinit(pwrfactor *pfactor, int n, int k, const double *factors)
+{
+	pfactor->n = n;
+	pfactor->k = k;
+	pfactor->loadings = factors;
+	pfactor->factorcov = &factors[(size_t)n*k];
+	pfactor->diagonal = &factors[(size_t)n*k + (size_t)k*k];
+}
+
+/** Y = Q0 X for a block of m vectors (m x n); work holds 2 k m doubles.
+ * B is read twice whatever m: once for B^T X, once for B (F B^T X), every row of B being used by
+ * all the vectors while it is in cache.
+ * **/
+void FACsymm(const pwrfactor *pfactor, int m, const double *x, double *y, double *work)
+{
+	int n = pfactor->n, k = pfactor->k, i, a, b, c;
+	const double *row, *f = pfactor->factorcov, *d = pfactor->diagonal;
+	double *t = work, *u = &work[(size_t)k*m], xi, sum;
+
+	/** T = B^T X, k x m stored by vector **/
+	memset(t, 0, (size_t)k*m*sizeof(double));
+	for (i = 0; i < n; i++) {
+		row = &pfactor->loadings[(size_t)i*k];
+		for (c = 0; c < m; c++) {
+			xi = x[(size_t)c*n + i];
+			for (a = 0; a < k; a++)
+				t[c*k + a] += row[a]*xi;
+		}
+	}
+
+	/** U = F T **/
+	for (c = 0; c < m; c++)
+		for (a = 0; a < k; a++) {
+			sum = 0;
+			for (b = 0; b < k; b++)
+				sum += f[a*k + b]*t[c*k + b];
+			u[c*k + a] = sum;
+		}
+
+	/** Y = B U + D X **/
+	for (i = 0; i < n; i++) {
+		row = &pfactor->loadings[(size_t)i*k];
+		for (c = 0; c < m; c++) {
+			sum = d[i]*x[(size_t)c*n + i];
+			for (a = 0; a < k; a++)
+				sum += row[a]*u[c*k + a];
+			y[(size_t)c*n + i] = sum;
+		}
+	}
+}
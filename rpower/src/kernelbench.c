@@ -0,0 +1,122 @@
+#include "utilities.h"
+#include "kernels.h"
+
+/** Microbenchmark of one power method iteration:
+ * the original loop (dense matvec, norm pass, error pass, copy back) against the packed
+ * symmetric kernel with fused norm/error and pointer swap, for every isa the cpu supports,
+ * with the matrix stored in double, float and bf16.
+ * usage: kernelbench [n] [iterations]
+ * **/
+
+/** the loop PWRpoweriteration used to run, kept here as the reference **/
+static double reference_iteration(int n, double *q, double *vector, double *newvector)
+{
+	double norm2 = 0, mult, error = 0;
+	int i, j;
+
+	for(i = 0; i < n; i++){
+		newvector[i] = 0;
+		for (j = 0; j < n; j++) {
+			newvector[i] += vector[j]*q[i*n + j];
+		}
+	}
+
+	for(j = 0; j < n; j++)
+		norm2 += newvector[j]*newvector[j];
+
+	mult = 1.0/sqrt(norm2);
+
+	for(j = 0; j < n; j++)
+		newvector[j] = newvector[j]*mult;
+
+	for (j = 0; j < n; j++)
+		error += fabs(newvector[j] - vector[j]);
+
+	for(j = 0; j < n; j++)
+		vector[j] = newvector[j];
+
+	return 1.0/mult;
+}
+
+static void report(char *name, int n, int iterations, double seconds, double matrixbytes, double eigenvalue)
+{
+	double flops = 2.0*n*(double)n;
+
+	printf("%-14s n %6d  %9.3f ms/iter  %8.2f GB/s  %8.2f GFLOP/s  eigenvalue %.10e\n",
+			name, n, 1e3*seconds/iterations,
+			matrixbytes*iterations/seconds*1e-9,
+			flops*iterations/seconds*1e-9, eigenvalue);
+}
+
+int main(int argc, char *argv[])
+{
+	int retcode = 0, n = 1000, iterations = 50, i, j, k, isa, precision;
+	unsigned int seed = 1;
+	double *q = NULL, *packed = NULL, *vector = NULL, *newvector = NULL, *swap;
+	double start, eigenvalue = 0, mult, norm2;
+	void *low[3] = {NULL, NULL, NULL};
+	char name[32];
+
+	if (argc > 1) n = atoi(argv[1]);
+	if (argc > 2) iterations = atoi(argv[2]);
+	if (n <= 0 || iterations <= 0) {
+		printf(" usage: kernelbench [n] [iterations]\n");
+		retcode = 1; goto BACK;
+	}
+
+	q = (double *)calloc((size_t)n*n, sizeof(double));
+	packed = (double *)calloc(KRNpackedsize(n), sizeof(double));
+	vector = (double *)calloc(n, sizeof(double));
+	newvector = (double *)calloc(n, sizeof(double));
+	if (!q || !packed || !vector || !newvector) {
+		printf("no memory for n = %d\n", n);
+		retcode = 1; goto BACK;
+	}
+
+	/** random symmetric matrix **/
+	for (i = 0; i < n; i++)
+		for (j = i; j < n; j++)
+			q[(size_t)i*n + j] = q[(size_t)j*n + i] = rand_r(&seed)/((double) RAND_MAX);
+	KRNpack(n, q, packed);
+	low[PRECDOUBLE] = packed;
+	for (precision = PRECFLOAT; precision <= PRECBF16; precision++) {
+		if (!(low[precision] = malloc(KRNpackedsize(n)*KRNprecisionbytes(precision)))) {
+			printf("no memory for n = %d\n", n);
+			retcode = 1; goto BACK;
+		}
+		KRNlower(precision, KRNpackedsize(n), packed, low[precision]);
+	}
+
+	for (j = 0; j < n; j++) vector[j] = 1.0;
+	start = PWRseconds();
+	for (k = 0; k < iterations; k++)
+		eigenvalue = reference_iteration(n, q, vector, newvector);
+	report("reference", n, iterations, PWRseconds() - start, 8.0*n*(double)n, eigenvalue);
+
+	for (isa = ISASCALAR; isa <= ISAAVX512; isa++) {
+		if (!KRNselect(isa))
+			continue;
+		for (precision = PRECDOUBLE; precision <= PRECBF16; precision++) {
+			for (j = 0; j < n; j++) vector[j] = 1.0;
+			start = PWRseconds();
+			for (k = 0; k < iterations; k++) {
+				KRNsymm(n, 1, precision, low[precision], vector, newvector, &norm2);
+				mult = 1.0/sqrt(norm2);
+				eigenvalue = 1.0/mult;
+				KRNscale_error(n, mult, newvector, vector);
+				swap = vector; vector = newvector; newvector = swap;
+			}
+			snprintf(name, sizeof(name), "%s/%s", KRNisaname(isa), KRNprecisionname(precision));
+			report(name, n, iterations, PWRseconds() - start, (double)KRNprecisionbytes(precision)*KRNpackedsize(n), eigenvalue);
+		}
+	}
+
+	BACK:
+	free(q);
+	free(packed);
+	free(low[PRECFLOAT]);
+	free(low[PRECBF16]);
+	free(vector);
+	free(newvector);
+	return retcode;
+}
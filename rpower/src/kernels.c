@@ -0,0 +1,505 @@
+#include <immintrin.h>
+#include <stdint.h>
+#include "utilities.h"
+#include "kernels.h"
+
+/** Matvec kernels on symmetric matrices stored as a packed upper triangle.
+ * Only half of the matrix is streamed from memory at every iteration, which is what
+ * matters since the power method is memory-bandwidth bound for large n.
+ * The SIMD variants are compiled with target attributes and selected at runtime
+ * so the binary still runs on machines without AVX2/AVX-512.
+ * The matrix can also be stored in float or bf16 (see KRNlower) to stream fewer bytes,
+ * its entries are widened to double in registers and everything else stays double.
+ * **/
+
+/** columns of a packed row processed per vector in KRNsymm, 4KB so the row block stays in L1 **/
+#define SYMMBLOCK 512
+
+typedef double (*krnrow)(int len, const void *a, const double *x, double *y, double xi);
+
+static double row_scalar(int len, const void *a, const double *x, double *y, double xi);
+static double row_avx2(int len, const void *a, const double *x, double *y, double xi);
+static double row_avx512(int len, const void *a, const double *x, double *y, double xi);
+static double rowf_scalar(int len, const void *a, const double *x, double *y, double xi);
+static double rowf_avx2(int len, const void *a, const double *x, double *y, double xi);
+static double rowf_avx512(int len, const void *a, const double *x, double *y, double xi);
+static double rowb_scalar(int len, const void *a, const double *x, double *y, double xi);
+static double rowb_avx2(int len, const void *a, const double *x, double *y, double xi);
+static double rowb_avx512(int len, const void *a, const double *x, double *y, double xi);
+
+/** returns sum a[j] x[j] and does y[j] += xi a[j], the inner loop of every symmetric product
+ * one kernel per storage precision, indexed by PRECDOUBLE, PRECFLOAT, PRECBF16
+ * **/
+static krnrow rowkernel[3] = {NULL, NULL, NULL};
+static int currentisa = ISASCALAR;
+
+/** pick the best kernel supported by this cpu; call once before starting threads **/
+void KRNinit(void)
+{
+	__builtin_cpu_init();
+	if (KRNselect(ISAAVX512)) return;
+	if (KRNselect(ISAAVX2)) return;
+	KRNselect(ISASCALAR);
+}
+
+/** force a kernel, returns 0 if the cpu does not support it **/
+int KRNselect(int isa)
+{
+	int supported = 0;
+
+	__builtin_cpu_init();
+	switch (isa) {
+	case ISAAVX512:
+		if ((supported = __builtin_cpu_supports("avx512f"))) {
+			rowkernel[PRECDOUBLE] = &row_avx512;
+			rowkernel[PRECFLOAT] = &rowf_avx512;
+			rowkernel[PRECBF16] = &rowb_avx512;
+		}
+		break;
+	case ISAAVX2:
+		if ((supported = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))) {
+			rowkernel[PRECDOUBLE] = &row_avx2;
+			rowkernel[PRECFLOAT] = &rowf_avx2;
+			rowkernel[PRECBF16] = &rowb_avx2;
+		}
+		break;
+	default:
+		isa = ISASCALAR;
+		rowkernel[PRECDOUBLE] = &row_scalar;
+		rowkernel[PRECFLOAT] = &rowf_scalar;
+		rowkernel[PRECBF16] = &rowb_scalar;
+		supported = 1;
+		break;
+	}
+	if (supported)
+		currentisa = isa;
+
+	return supported;
+}
+
+int KRNisa(void)
+{
+	return currentisa;
+}
+
+const char *KRNisaname(int isa)
+{
+	switch (isa) {
+	case ISAAVX512: return "avx512";
+	case ISAAVX2: return "avx2";
+	default: return "scalar";
+	}
+}
+
+/** index of a_ii in the packed array **/
+size_t KRNrowoffset(int n, int i)
+{
+	return (size_t)i*n - (size_t)i*(i - 1)/2;
+}
+
+size_t KRNprecisionbytes(int precision)
+{
+	switch (precision) {
+	case PRECFLOAT: return sizeof(float);
+	case PRECBF16: return sizeof(uint16_t);
+	default: return sizeof(double);
+	}
+}
+
+const char *KRNprecisionname(int precision)
+{
+	switch (precision) {
+	case PRECFLOAT: return "float";
+	case PRECBF16: return "bf16";
+	default: return "double";
+	}
+}
+
+static double bf16todouble(uint16_t h)
+{
+	uint32_t bits = (uint32_t)h << 16;
+	float value;
+
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+/** round count packed doubles to the given storage precision (bf16: to nearest even) **/
+void KRNlower(int precision, size_t count, const double *packed, void *low)
+{
+	size_t k;
+	float value;
+	uint32_t bits;
+
+	for (k = 0; k < count; k++) {
+		value = (float) packed[k];
+		switch (precision) {
+		case PRECFLOAT:
+			((float *) low)[k] = value;
+			break;
+		case PRECBF16:
+			memcpy(&bits, &value, sizeof(bits));
+			bits += 0x7fff + ((bits >> 16) & 1);
+			((uint16_t *) low)[k] = (uint16_t)(bits >> 16);
+			break;
+		default:
+			((double *) low)[k] = packed[k];
+			break;
+		}
+	}
+}
+
+/** a_ij of a row pointer, in any precision **/
+static double entry(int precision, const char *a)
+{
+	switch (precision) {
+	case PRECFLOAT: return *(const float *) a;
+	case PRECBF16: return bf16todouble(*(const uint16_t *) a);
+	default: return *(const double *) a;
+	}
+}
+
+/** copy the upper triangle of a full row-major matrix into packed storage **/
+void KRNpack(int n, double *matrix, double *packed)
+{
+	int i, j;
+	double *row = packed;
+
+	for (i = 0; i < n; i++) {
+		for (j = i; j < n; j++)
+			row[j - i] = matrix[(size_t)i*n + j];
+		row += n - i;
+	}
+}
+
+/** expand packed storage back into a full row-major matrix **/
+void KRNunpack(int n, double *packed, double *matrix)
+{
+	int i, j;
+	double *row = packed;
+
+	for (i = 0; i < n; i++) {
+		for (j = i; j < n; j++) {
+			matrix[(size_t)i*n + j] = row[j - i];
+			matrix[(size_t)j*n + i] = row[j - i];
+		}
+		row += n - i;
+	}
+}
+
+/** y = Q x with Q packed, returns ||y||^2
+ * Row i contributes a_ij x_j to y_i and a_ij x_i to y_j (j > i), so once row i is
+ * processed y_i is final and its square can go into the norm within the same pass.
+ * **/
+double KRNsymv(int n, const double *packed, const double *x, double *y)
+{
+	double norm2;
+
+	KRNsymm(n, 1, PRECDOUBLE, packed, x, y, &norm2);
+
+	return norm2;
+}
+
+/** Y = Q X for a block of m vectors stored one after the other (m x n, like powerbag vectors)
+ * packed holds entries of the given precision.
+ * If norm2 is not NULL it receives the squared norm of every column of Y.
+ * **/
+void KRNsymm(int n, int m, int precision, const void *packed, const double *x, double *y, double *norm2)
+{
+	int c;
+
+	for (c = 0; c < m; c++) {
+		memset(&y[(size_t)c*n], 0, n*sizeof(double));
+		if (norm2) norm2[c] = 0;
+	}
+
+	KRNsymmrows(n, m, precision, packed, x, y, 0, n, norm2);
+}
+
+/** adds the contribution of rows rowbegin .. rowend-1 of Q to Y = Q X
+ * Row i of the packed triangle touches y_i and every y_j with j > i, so y must hold zeros
+ * (or earlier contributions) from rowbegin to n. Each row is cut in blocks of SYMMBLOCK
+ * entries that are applied to all m vectors before moving on, so the matrix is streamed
+ * from memory once for the whole block. Separate row ranges can run in parallel on
+ * separate y buffers (see team.c).
+ * When all rows are done by one call y_i is final right after row i, and if norm2 is not
+ * NULL its square is accumulated there, saving a pass over y.
+ * **/
+void KRNsymmrows(int n, int m, int precision, const void *packed, const double *x, double *y, int rowbegin, int rowend, double *norm2)
+{
+	KRNsymmband(n, m, precision, (const char *) packed + KRNrowoffset(n, rowbegin)*KRNprecisionbytes(precision), x, y, rowbegin, rowend, norm2);
+}
+
+/** the same with only rows rowbegin .. rowend-1 in memory, band pointing at a_(rowbegin)(rowbegin)
+ * (an out of core sweep, see stream.c, brings the matrix in one band after the other)
+ * **/
+void KRNsymmband(int n, int m, int precision, const void *band, const double *x, double *y, int rowbegin, int rowend, double *norm2)
+{
+	int i, jb, len, c;
+	size_t cn, bytes = KRNprecisionbytes(precision);
+	const char *row = (const char *) band, *a;
+	double aii;
+	krnrow kernel;
+
+	if (rowkernel[PRECDOUBLE] == NULL)
+		KRNinit();
+	kernel = rowkernel[precision];
+
+	for (i = rowbegin; i < rowend; i++) {
+		a = row - i*bytes; /** so that a + j*bytes points to a_ij **/
+		for (jb = i + 1; jb < n; jb += SYMMBLOCK) {
+			len = n - jb;
+			if (len > SYMMBLOCK) len = SYMMBLOCK;
+			for (c = 0, cn = 0; c < m; c++, cn += n)
+				y[cn + i] += kernel(len, a + jb*bytes, &x[cn + jb], &y[cn + jb], x[cn + i]);
+		}
+		aii = entry(precision, a + i*bytes);
+		for (c = 0, cn = 0; c < m; c++, cn += n) {
+			y[cn + i] += aii*x[cn + i];
+			if (norm2) norm2[c] += y[cn + i]*y[cn + i];
+		}
+		row += (n - i)*bytes;
+	}
+}
+
+/** newvector *= mult and returns the L1 distance to vector divided by n, in one pass **/
+double KRNscale_error(int n, double mult, double *newvector, double *vector)
+{
+	int j;
+	double error = 0;
+
+	for (j = 0; j < n; j++) {
+		newvector[j] *= mult;
+		error += fabs(newvector[j] - vector[j]);
+	}
+
+	return error/n;
+}
+
+/** Q += alpha w w^T on the packed upper triangle **/
+void KRNrank1update(int n, double *packed, double alpha, double *w)
+{
+	int i, j;
+	double *row = packed, awi;
+
+	for (i = 0; i < n; i++) {
+		awi = alpha*w[i];
+		for (j = i; j < n; j++)
+			row[j - i] += awi*w[j];
+		row += n - i;
+	}
+}
+
+static double row_scalar(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	double t = 0;
+	const double *a = (const double *) pa;
+
+	for (j = 0; j < len; j++) {
+		t += a[j]*x[j];
+		y[j] += a[j]*xi;
+	}
+
+	return t;
+}
+
+__attribute__((target("avx2,fma")))
+static double row_avx2(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	double t;
+	const double *a = (const double *) pa;
+	__m256d vxi, acc, va;
+	__m128d lo;
+
+	vxi = _mm256_set1_pd(xi);
+	acc = _mm256_setzero_pd();
+	for (j = 0; j + 4 <= len; j += 4) {
+		va = _mm256_loadu_pd(&a[j]);
+		acc = _mm256_fmadd_pd(va, _mm256_loadu_pd(&x[j]), acc);
+		_mm256_storeu_pd(&y[j], _mm256_fmadd_pd(va, vxi, _mm256_loadu_pd(&y[j])));
+	}
+	lo = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+	t = _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+	for (; j < len; j++) {
+		t += a[j]*x[j];
+		y[j] += a[j]*xi;
+	}
+
+	return t;
+}
+
+__attribute__((target("avx512f")))
+static double row_avx512(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	const double *a = (const double *) pa;
+	__m512d vxi, acc, va;
+	__mmask8 tail;
+
+	vxi = _mm512_set1_pd(xi);
+	acc = _mm512_setzero_pd();
+	for (j = 0; j + 8 <= len; j += 8) {
+		va = _mm512_loadu_pd(&a[j]);
+		acc = _mm512_fmadd_pd(va, _mm512_loadu_pd(&x[j]), acc);
+		_mm512_storeu_pd(&y[j], _mm512_fmadd_pd(va, vxi, _mm512_loadu_pd(&y[j])));
+	}
+	if (j < len) {
+		/** masked remainder, avoids a scalar tail on every row **/
+		tail = (__mmask8)((1u << (len - j)) - 1);
+		va = _mm512_maskz_loadu_pd(tail, &a[j]);
+		acc = _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(tail, &x[j]), acc);
+		_mm512_mask_storeu_pd(&y[j], tail, _mm512_fmadd_pd(va, vxi, _mm512_maskz_loadu_pd(tail, &y[j])));
+	}
+
+	return _mm512_reduce_add_pd(acc);
+}
+
+/** float and bf16 storage: same loops, the entries are widened to double after the load **/
+
+static double rowf_scalar(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	double t = 0, aj;
+	const float *a = (const float *) pa;
+
+	for (j = 0; j < len; j++) {
+		aj = a[j];
+		t += aj*x[j];
+		y[j] += aj*xi;
+	}
+
+	return t;
+}
+
+__attribute__((target("avx2,fma")))
+static double rowf_avx2(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	double t, aj;
+	const float *a = (const float *) pa;
+	__m256d vxi, acc, va;
+	__m128d lo;
+
+	vxi = _mm256_set1_pd(xi);
+	acc = _mm256_setzero_pd();
+	for (j = 0; j + 4 <= len; j += 4) {
+		va = _mm256_cvtps_pd(_mm_loadu_ps(&a[j]));
+		acc = _mm256_fmadd_pd(va, _mm256_loadu_pd(&x[j]), acc);
+		_mm256_storeu_pd(&y[j], _mm256_fmadd_pd(va, vxi, _mm256_loadu_pd(&y[j])));
+	}
+	lo = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+	t = _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+	for (; j < len; j++) {
+		aj = a[j];
+		t += aj*x[j];
+		y[j] += aj*xi;
+	}
+
+	return t;
+}
+
+__attribute__((target("avx512f")))
+static double rowf_avx512(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	const float *a = (const float *) pa;
+	__m512d vxi, acc, va;
+	__mmask8 tail;
+
+	vxi = _mm512_set1_pd(xi);
+	acc = _mm512_setzero_pd();
+	for (j = 0; j + 8 <= len; j += 8) {
+		va = _mm512_cvtps_pd(_mm256_loadu_ps(&a[j]));
+		acc = _mm512_fmadd_pd(va, _mm512_loadu_pd(&x[j]), acc);
+		_mm512_storeu_pd(&y[j], _mm512_fmadd_pd(va, vxi, _mm512_loadu_pd(&y[j])));
+	}
+	if (j < len) {
+		tail = (__mmask8)((1u << (len - j)) - 1);
+		va = _mm512_cvtps_pd(_mm512_castps512_ps256(_mm512_maskz_loadu_ps((__mmask16) tail, &a[j])));
+		acc = _mm512_fmadd_pd(va, _mm512_maskz_loadu_pd(tail, &x[j]), acc);
+		_mm512_mask_storeu_pd(&y[j], tail, _mm512_fmadd_pd(va, vxi, _mm512_maskz_loadu_pd(tail, &y[j])));
+	}
+
+	return _mm512_reduce_add_pd(acc);
+}
+
+static double rowb_scalar(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	double t = 0, aj;
+	const uint16_t *a = (const uint16_t *) pa;
+
+	for (j = 0; j < len; j++) {
+		aj = bf16todouble(a[j]);
+		t += aj*x[j];
+		y[j] += aj*xi;
+	}
+
+	return t;
+}
+
+/** 8 bf16 entries to 8 floats: zero extend to 32 bits and shift into the high half **/
+__attribute__((target("avx2,fma")))
+static __m256 bf16x8(const uint16_t *a)
+{
+	return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) a)), 16));
+}
+
+__attribute__((target("avx2,fma")))
+static double rowb_avx2(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	double t, aj;
+	const uint16_t *a = (const uint16_t *) pa;
+	__m256d vxi, acc, va, vb;
+	__m256 v;
+	__m128d lo;
+
+	vxi = _mm256_set1_pd(xi);
+	acc = _mm256_setzero_pd();
+	for (j = 0; j + 8 <= len; j += 8) {
+		v = bf16x8(&a[j]);
+		va = _mm256_cvtps_pd(_mm256_castps256_ps128(v));
+		vb = _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1));
+		acc = _mm256_fmadd_pd(va, _mm256_loadu_pd(&x[j]), acc);
+		acc = _mm256_fmadd_pd(vb, _mm256_loadu_pd(&x[j + 4]), acc);
+		_mm256_storeu_pd(&y[j], _mm256_fmadd_pd(va, vxi, _mm256_loadu_pd(&y[j])));
+		_mm256_storeu_pd(&y[j + 4], _mm256_fmadd_pd(vb, vxi, _mm256_loadu_pd(&y[j + 4])));
+	}
+	lo = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+	t = _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+	for (; j < len; j++) {
+		aj = bf16todouble(a[j]);
+		t += aj*x[j];
+		y[j] += aj*xi;
+	}
+
+	return t;
+}
+
+__attribute__((target("avx512f,avx2")))
+static double rowb_avx512(int len, const void *pa, const double *x, double *y, double xi)
+{
+	int j;
+	double t, aj;
+	const uint16_t *a = (const uint16_t *) pa;
+	__m512d vxi, acc, va;
+
+	vxi = _mm512_set1_pd(xi);
+	acc = _mm512_setzero_pd();
+	for (j = 0; j + 8 <= len; j += 8) {
+		va = _mm512_cvtps_pd(_mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *) &a[j])), 16)));
+		acc = _mm512_fmadd_pd(va, _mm512_loadu_pd(&x[j]), acc);
+		_mm512_storeu_pd(&y[j], _mm512_fmadd_pd(va, vxi, _mm512_loadu_pd(&y[j])));
+	}
+	t = _mm512_reduce_add_pd(acc);
+	for (; j < len; j++) {
+		aj = bf16todouble(a[j]);
+		t += aj*x[j];
+		y[j] += aj*xi;
+	}
+
+	return t;
+}
@@ -0,0 +1,38 @@
+#ifndef KERNELS
+#define KERNELS
+
+#include <stddef.h>
+
+/** instruction sets the matvec kernels can be dispatched to **/
+#define ISASCALAR 0
+#define ISAAVX2 1
+#define ISAAVX512 2
+
+/** storage precisions of the packed matrix, the vectors and the accumulation are always double **/
+#define PRECDOUBLE 0
+#define PRECFLOAT 1
+#define PRECBF16 2 /** upper 16 bits of a float: 8 bit mantissa, experimental **/
+
+/** number of doubles in the packed upper triangle of a symmetric n x n matrix
+ * row i is stored from its diagonal entry onwards: a_ii, a_i(i+1), ..., a_i(n-1)
+ * **/
+#define KRNpackedsize(n) ((size_t)(n)*((size_t)(n) + 1)/2)
+
+void KRNinit(void);
+int KRNselect(int isa);
+int KRNisa(void);
+const char *KRNisaname(int isa);
+size_t KRNrowoffset(int n, int i);
+size_t KRNprecisionbytes(int precision);
+const char *KRNprecisionname(int precision);
+void KRNlower(int precision, size_t count, const double *packed, void *low);
+void KRNpack(int n, double *matrix, double *packed);
+void KRNunpack(int n, double *packed, double *matrix);
+double KRNsymv(int n, const double *packed, const double *x, double *y);
+void KRNsymm(int n, int m, int precision, const void *packed, const double *x, double *y, double *norm2);
+void KRNsymmrows(int n, int m, int precision, const void *packed, const double *x, double *y, int rowbegin, int rowend, double *norm2);
+void KRNsymmband(int n, int m, int precision, const void *band, const double *x, double *y, int rowbegin, int rowend, double *norm2);
+double KRNscale_error(int n, double mult, double *newvector, double *vector);
+void KRNrank1update(int n, double *packed, double alpha, double *w);
+
+#endif
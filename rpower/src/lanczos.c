@@ -0,0 +1,204 @@
+#include <pthread.h>
+#include "utilities.h"
+#include "power.h"
+#include "linalg.h"
+
+/** Thick restart Lanczos: a Krylov basis of m = pbag->krylov vectors is grown one matvec at a time,
+ * the r top eigen pairs come from a Rayleigh-Ritz step on the projected m x m matrix T.
+ * When the basis is full and the pairs have not converged, the basis is shrunk to its best
+ * Ritz vectors plus the last Lanczos vector and grown again (this is the implicitly restarted
+ * Lanczos method with exact shifts, without the QR sweeps on T).
+ * Every new vector is orthogonalized twice against the whole basis (full reorthogonalization),
+ * which costs O(m n) per step, small next to the O(n^2) matvec, and keeps the Ritz values
+ * free of spurious copies. The coefficients of that orthogonalization are the entries of T.
+ * The error of a pair is its residual norm |A u - theta u|, known from T without any matvec,
+ * relative to the top eigen value.
+ * In a low precision run the pairs first converge on the low precision matrix, then a new basis is
+ * grown on the double matrix from the sum of their Ritz vectors (a warm start, a few matvecs).
+ * **/
+
+/** orthogonalize x against the j vectors of basis, twice; h (if not NULL) receives the coefficients **/
+static void reorthogonalize(int n, int j, double *basis, double *x, double *h)
+{
+	int i, pass;
+	double coef;
+
+	if (h)
+		memset(h, 0, j*sizeof(double));
+	for (pass = 0; pass < 2; pass++)
+		for (i = 0; i < j; i++) {
+			coef = LINdot(n, &basis[(size_t)i*n], x);
+			LINaxpy(n, -coef, &basis[(size_t)i*n], x);
+			if (h)
+				h[i] += coef;
+		}
+}
+
+/** the Krylov space is invariant, continue with a random direction orthogonal to the basis, the
+ * next one of the RNGRESTART stream of the job
+ * **/
+static void newdirection(powerbag *pbag, int j, double *basis, double *x)
+{
+	int i, n = pbag->n;
+	double norm;
+
+	do {
+		RNGuniform(pbag->seed[0], pbag->jobnumber, RNGRESTART, (size_t)pbag->draws++*n, n, x);
+		for (i = 0; i < n; i++)
+			x[i] -= 0.5;
+		reorthogonalize(n, j, basis, x, NULL);
+		norm = sqrt(LINdot(n, x, x));
+	} while (norm < 1e-8);
+
+	for (i = 0; i < n; i++)
+		x[i] /= norm;
+}
+
+/** Rayleigh-Ritz on the first size basis vectors: theta and y (size x size) receive the Ritz pairs of T
+ * returns the largest residual of the r wanted pairs relative to the top eigen value, the residual of
+ * pair c being beta times the last component of its vector in T
+ * **/
+static double ritzpairs(int m, int size, int r, double *t, double *h, double *y, double *theta, double beta)
+{
+	int a, c;
+	double residual, maxresidual = 0;
+
+	for (a = 0; a < size; a++)
+		for (c = 0; c < size; c++)
+			h[a*size + c] = t[a*m + c];
+	LINjacobi(size, h, theta, y);
+
+	for (c = 0; c < r; c++) {
+		residual = fabs(beta*y[(size - 1)*size + c])/fabs(theta[0]);
+		if (residual > maxresidual)
+			maxresidual = residual;
+	}
+
+	return maxresidual;
+}
+
+/** returns 1 if the job was interrupted **/
+int PWRlanczos(powerbag *pbag)
+{
+	int n, r, m, ID, j, i, c, kept, matvecs, restarts, done, size = 0;
+	double *basis, *ritz, *t, *h, *y, *theta, *w;
+	double beta = 0, norm, maxresidual = 1, tolerance;
+	int interrupting = 0;
+	pwroperator op;
+
+	ID = pbag->ID;
+	n = pbag->n;
+	r = pbag->r;
+	m = pbag->krylov;
+	tolerance = pbag->tolerance;
+	basis = pbag->krylovwork; /** (m + 1) x n **/
+	ritz = &basis[(size_t)(m + 1)*n]; /** m x n, restart vectors **/
+	t = &ritz[(size_t)m*n]; /** m x m **/
+	h = &t[m*m]; /** m x m, copy of T destroyed by LINjacobi **/
+	y = &h[m*m]; /** m x m Ritz vectors of T **/
+	theta = &y[m*m]; /** m **/
+
+	/** Q = Q0 + s s^T, nothing deflated **/
+	OPinit(&op, n, pbag->qcopy, pbag->scratch, NULL, NULL);
+	op.pteam = pbag->pteam;
+	OPlowprecision(&op, pbag->precision, pbag->lowmatrix);
+	OPfactor(&op, pbag->factor, pbag->factorwork);
+	OPstream(&op, pbag->stream);
+
+	/** a warm start has r nearly converged vectors, the Krylov space of their sum holds them all **/
+	memcpy(basis, pbag->vector0, n*sizeof(double));
+	if (pbag->warm)
+		for (c = 1; c < r; c++)
+			LINaxpy(n, 1.0, &pbag->vector0[(size_t)c*n], basis);
+	norm = sqrt(LINdot(n, basis, basis));
+	for (i = 0; i < n; i++)
+		basis[i] /= norm;
+	memset(t, 0, (size_t)m*m*sizeof(double));
+
+	kept = 0;
+	matvecs = 0;
+	pbag->refined[0] = 0;
+	for (restarts = 0; ; restarts++) {
+		/** grow the basis from kept up to m vectors, T gets column j at step j; the wanted pairs are
+		 * tested after every step, so that a warm started job stops as soon as they are good **/
+		for (j = kept; j < m; j++) {
+			w = &basis[(size_t)(j + 1)*n];
+			OPapply(&op, 1, &basis[(size_t)j*n], w, NULL);
+			++matvecs;
+			if (op.precision == PRECDOUBLE && pbag->precision != PRECDOUBLE)
+				++pbag->refined[0];
+			reorthogonalize(n, j + 1, basis, w, h);
+			for (i = 0; i <= j; i++)
+				t[i*m + j] = t[j*m + i] = h[i];
+			beta = sqrt(LINdot(n, w, w));
+			if (beta < 1e-12*fabs(t[0]) || beta == 0) {
+				beta = 0;
+				if (j + 1 < n)
+					newdirection(pbag, j + 1, basis, w);
+				else
+					memset(w, 0, n*sizeof(double)); /** the basis spans everything, nothing is left out **/
+			}
+			else
+				for (i = 0; i < n; i++)
+					w[i] /= beta;
+			if (j + 1 < m)
+				t[(j + 1)*m + j] = t[j*m + j + 1] = beta;
+
+			size = j + 1;
+			if (size >= r && (maxresidual = ritzpairs(m, size, r, t, h, y, theta, beta)) < tolerance)
+				break;
+		}
+
+		pthread_mutex_lock(pbag->poutputmutex);
+		printf("ID %d at restart %d (%d matvecs), top eigenvalue %g, ", ID, restarts, matvecs, theta[0]);
+		printf("  max relative residual = %.9e\n", maxresidual);
+		pthread_mutex_unlock(pbag->poutputmutex);
+
+		done = maxresidual < tolerance || (interrupting = PWRcheckinterrupt(pbag, matvecs, maxresidual));
+		if (done && !interrupting && op.precision != PRECDOUBLE) {
+			/** converged on the low precision matrix: restart on the double one from the sum of the Ritz vectors **/
+			memset(ritz, 0, n*sizeof(double));
+			for (c = 0; c < r; c++)
+				for (i = 0; i < size; i++)
+					LINaxpy(n, y[i*size + c], &basis[(size_t)i*n], ritz);
+			norm = sqrt(LINdot(n, ritz, ritz));
+			for (i = 0; i < n; i++)
+				basis[i] = ritz[i]/norm;
+			memset(t, 0, (size_t)m*m*sizeof(double));
+			op.precision = PRECDOUBLE;
+			kept = 0;
+			continue;
+		}
+		kept = done ? r : (r + (m - r)/2 < m - 1 ? r + (m - r)/2 : m - 1);
+
+		/** the kept Ritz vectors become the first basis vectors, T becomes diagonal on them **/
+		memset(ritz, 0, (size_t)kept*n*sizeof(double));
+		for (c = 0; c < kept; c++)
+			for (i = 0; i < size; i++)
+				LINaxpy(n, y[i*size + c], &basis[(size_t)i*n], &ritz[(size_t)c*n]);
+		memcpy(basis, ritz, (size_t)kept*n*sizeof(double));
+		memcpy(&basis[(size_t)kept*n], &basis[(size_t)size*n], n*sizeof(double));
+		memset(t, 0, (size_t)m*m*sizeof(double));
+		for (c = 0; c < kept; c++)
+			t[c*m + c] = theta[c];
+
+		if (done)
+			break;
+	}
+
+	for (c = 0; c < r; c++)
+		pbag->eigenvalue[c] = theta[c];
+	memcpy(pbag->vector, basis, (size_t)r*n*sizeof(double));
+	pbag->iterations[0] = restarts + 1;
+	pbag->matvecs[0] = matvecs;
+
+	if (!interrupting) {
+		pthread_mutex_lock(pbag->poutputmutex);
+		printf(" ID %d lanczos converged to tolerance %g! on job %d after %d matvecs\n", ID, tolerance, pbag->jobnumber, matvecs);
+		for (c = 0; c < r; c++)
+			printf(" ID %d %d-th eigenvalue:  %g!\n", ID, c, pbag->eigenvalue[c]);
+		pthread_mutex_unlock(pbag->poutputmutex);
+	}
+
+	return interrupting;
+}
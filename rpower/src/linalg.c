@@ -0,0 +1,123 @@
+#include "utilities.h"
+#include "linalg.h"
+
+/** Small dense linear algebra used by the block engines.
+ * Blocks of vectors are stored one vector after the other (m x n), like powerbag vectors;
+ * small m x m matrices are row-major.
+ * **/
+
+double LINdot(int n, double *x, double *y)
+{
+	int j;
+	double sum = 0;
+
+	for (j = 0; j < n; j++)
+		sum += x[j]*y[j];
+
+	return sum;
+}
+
+/** y += alpha x **/
+void LINaxpy(int n, double alpha, double *x, double *y)
+{
+	int j;
+
+	for (j = 0; j < n; j++)
+		y[j] += alpha*x[j];
+}
+
+/** modified Gram-Schmidt on the m vectors of x, in order, done twice for stability
+ * returns the number of vectors that had to be replaced because they were numerically dependent
+ * **/
+int LINorthonormalize(int n, int m, double *x)
+{
+	int c, d, pass, dependent = 0;
+	double norm, *xc;
+
+	for (c = 0; c < m; c++) {
+		xc = &x[(size_t)c*n];
+		for (pass = 0; pass < 2; pass++)
+			for (d = 0; d < c; d++)
+				LINaxpy(n, -LINdot(n, &x[(size_t)d*n], xc), &x[(size_t)d*n], xc);
+		norm = sqrt(LINdot(n, xc, xc));
+		if (norm < 1e-300) {
+			/** lost this direction, restart it from a unit vector and orthogonalize again **/
+			memset(xc, 0, n*sizeof(double));
+			xc[(c + dependent) % n] = 1.0;
+			++dependent;
+			--c;
+			continue;
+		}
+		for (d = 0; d < n; d++)
+			xc[d] /= norm;
+	}
+
+	return dependent;
+}
+
+/** cyclic Jacobi eigen decomposition of the symmetric m x m matrix a (destroyed)
+ * eigenvalues come out sorted in decreasing order, column c of v is the c-th eigenvector
+ * **/
+void LINjacobi(int m, double *a, double *eigenvalue, double *v)
+{
+	int i, j, k, sweep;
+	double off, theta, t, c, s, aki, akj, vki, vkj, tmp;
+
+	for (i = 0; i < m; i++)
+		for (j = 0; j < m; j++)
+			v[i*m + j] = (i == j) ? 1.0 : 0.0;
+
+	for (sweep = 0; sweep < 100; sweep++) {
+		off = 0;
+		for (i = 0; i < m; i++)
+			for (j = i + 1; j < m; j++)
+				off += a[i*m + j]*a[i*m + j];
+		if (off < 1e-300)
+			break;
+
+		for (i = 0; i < m; i++) {
+			for (j = i + 1; j < m; j++) {
+				if (a[i*m + j] == 0.0)
+					continue;
+				theta = (a[j*m + j] - a[i*m + i])/(2*a[i*m + j]);
+				t = (theta >= 0 ? 1.0 : -1.0)/(fabs(theta) + sqrt(theta*theta + 1));
+				c = 1/sqrt(t*t + 1);
+				s = t*c;
+				for (k = 0; k < m; k++) {
+					aki = a[k*m + i];
+					akj = a[k*m + j];
+					a[k*m + i] = c*aki - s*akj;
+					a[k*m + j] = s*aki + c*akj;
+				}
+				for (k = 0; k < m; k++) {
+					aki = a[i*m + k];
+					akj = a[j*m + k];
+					a[i*m + k] = c*aki - s*akj;
+					a[j*m + k] = s*aki + c*akj;
+				}
+				for (k = 0; k < m; k++) {
+					vki = v[k*m + i];
+					vkj = v[k*m + j];
+					v[k*m + i] = c*vki - s*vkj;
+					v[k*m + j] = s*vki + c*vkj;
+				}
+			}
+		}
+	}
+
+	for (i = 0; i < m; i++)
+		eigenvalue[i] = a[i*m + i];
+
+	/** selection sort, decreasing **/
+	for (i = 0; i < m; i++) {
+		k = i;
+		for (j = i + 1; j < m; j++)
+			if (eigenvalue[j] > eigenvalue[k]) k = j;
+		if (k != i) {
+			tmp = eigenvalue[i]; eigenvalue[i] = eigenvalue[k]; eigenvalue[k] = tmp;
+			for (j = 0; j < m; j++) {
+				tmp = v[j*m + i]; v[j*m + i] = v[j*m + k]; v[j*m + k] = tmp;
+			}
+		}
+	}
+}
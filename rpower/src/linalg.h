@@ -0,0 +1,9 @@
+#ifndef LINALG
+#define LINALG
+
+double LINdot(int n, double *x, double *y);
+void LINaxpy(int n, double alpha, double *x, double *y);
+int LINorthonormalize(int n, int m, double *x);
+void LINjacobi(int m, double *a, double *eigenvalue, double *v);
+
+#endif
@@ -3,17 +3,54 @@
 #include <pthread.h>
 #include <unistd.h>
 #include <signal.h>
+#include <limits.h>
 #include "utilities.h"
 #include "power.h"
+#include "kernels.h"
+#include "team.h"
+#include "aggregate.h"
+#include "sink.h"
+#include "topology.h"
+#include "rolling.h"
+#include "daemon.h"
+#include "checkpoint.h"
+#include "scheduler.h"
 
 static powerbag **ppbagproxy = NULL;
 static int numworkersproxy = 0;
-static char *deadstatus = NULL;
-static int activeworkers = 0;
+static volatile sig_atomic_t stopping = 0; /** every worker polls it, see PWRcheckinterrupt **/
+
+/** what a worker thread starts from: with a placement it pins itself and allocates its own bag,
+ * so that its buffers are first touched on its node, otherwise the master has allocated the bag
+ * **/
+typedef struct workerstart{
+	int ID;
+	int n;
+	double *matrix; /** base matrix, the copy of the worker's node **/
+	powerconfig config; /** lowmatrix is the copy of the worker's node too **/
+	pwrtopology *ptopo; /** NULL without placement **/
+	int firstcpu; /** in the placement order, config.teamsize cpus from there **/
+	powerbag **ppbag;
+	pwrqueue *pjobs;
+	pwrqueue *pdone;
+	pthread_mutex_t *poutputmutex;
+	pthread_barrier_t *pready; /** the master waits there for every bag **/
+	int retcode;
+}workerstart;
+
+int cheap_rank1perturb(int n, double *scratch, unsigned int seed, unsigned int job, double scale);
+
+/** queue order: higher priority first, then by job number **/
+static int comparejobs(const void *pa, const void *pb)
+{
+	const powerjob *a = (const powerjob *) pa, *b = (const powerjob *) pb;
 
-int cheap_rank1perturb(int n, double *scratch, double *matcopy, double *matrix, unsigned int* pseed, double scale);
+	if (a->priority != b->priority)
+		return a->priority > b->priority ? -1 : 1;
+	return a->jobnumber - b->jobnumber;
+}
 
-void *PWR_wrapper(void *pvoidedbag);
+void *PWR_wrapper(void *pvoidedstart);
 void (*sigset(int sig, void (*disp)(int)))(int);
 
 void handlesigint(int i);
@@ -21,24 +58,63 @@ void handlesigint(int i);
 
 int main(int argc, char *argv[])
 {
-	int retcode = 0, j, n, initialruns, scheduledjobs;
+	int retcode = 0, j, n = 0, numbatches;
 	powerbag **ppbag = NULL, *pbag;
 	double scale = 1.0;
-	int quantity = 1, numworkers = 1, theworker;
-	char gotone;
-	double *covmatrix;
+	int quantity = 1, numworkers = 1;
+	double *covmatrix = NULL, *basevector = NULL, *lowmatrix = NULL, *factors = NULL;
+	int k = 0;
+	pwrfactor factor;
+	size_t matrixcount;
 	int r;
 	double tolerance;
 	pthread_t *pthread;
 	pthread_mutex_t outputmutex;
-	pthread_mutex_t *psyncmutex;
-	/**unsigned int rseed = 123;**/
+	powerconfig config;
+	powerjob *pjob = NULL;
+	powerresult *presult;
+	pwrqueue jobqueue, donequeue;
+	int engine = ENGINEPOWER, sharedmatrix = 1, batch = 1, batchcount, teamsize = 0, krylov = 0, warmstart = WARMRANDOM, precision = PRECDOUBLE;
+	char *probefile = NULL, *resultfile = NULL;
+	int placement = PLACENONE, node, window = 0, servedcount = 1;
+	char *socketpath = NULL, *served[DAEMONMAXMATRICES];
+	char *checkpointfile = NULL;
+	double checkpointinterval = CKPINTERVAL;
+	pwrcheckpoint checkpoint;
+	int status, earlier = 0, ckpdone = 0, ckpinterrupted = 0;
+	double budget = 0, deadline = 0;
+	int maxiterations = 0, *priority = NULL;
+	char *priorities = NULL;
+	pwrscheduler scheduler;
+	pwrtopology topology;
+	double *matrixreplica[TOPOMAXNODES], *lowreplica[TOPOMAXNODES];
+	workerstart *pstart = NULL;
+	pthread_barrier_t ready;
+	pwrsink sink;
+	long residentbefore, totaliterations = 0, totalmatvecs = 0;
+	int donejobs = 0, interrupted = 0;
+	double loadstart, loadseconds, solvestart, solveseconds;
+	unsigned int seed = 0;
+	double streammegabytes = 0, epsilon = 0;
+	int verbose = 0, dropped;
+	pwraggregate aggregate;
+	uint64_t streamchecksum = 0;
+
+	memset(&jobqueue, 0, sizeof(pwrqueue));
+	memset(&donequeue, 0, sizeof(pwrqueue));
+	memset(&sink, 0, sizeof(pwrsink));
+	memset(&topology, 0, sizeof(pwrtopology));
+	memset(&checkpoint, 0, sizeof(pwrcheckpoint));
+	memset(&scheduler, 0, sizeof(pwrscheduler));
+	memset(&aggregate, 0, sizeof(pwraggregate));
+	memset(matrixreplica, 0, sizeof(matrixreplica));
+	memset(lowreplica, 0, sizeof(lowreplica));
 
 	r = 2; /** default number of factors **/
 	tolerance = 1e-6; /** default tolerance parameter**/
 
 	if(argc < 2){
-		printf(" usage: rpower filename [-s scale] [-q quantity] [-w workers] [-r num of eigen vals] [-t tolerance]\n");
+		printf(" usage: rpower filename [-s scale] [-q quantity] [-w workers] [-r num of eigen vals] [-t tolerance] [-e power|subspace|lanczos] [-k lanczos basis size] [-i random|base|last starting vectors] [-p double|float|bf16 matrix precision] [-m shared|private] [-b batch] [-T threads per job, 0 = auto] [-N none|compact|scatter worker placement] [-o results file, the console only gets the summary unless -v] [-J probe.json] [-R window: track a returns file day by day] [-S socket: serve requests, see daemon.h] [-M more matrices to serve] [-C checkpoint file, resumed if it exists] [-I seconds between checkpoints] [-B seconds per job] [-D seconds before the deadline of the run] [-P job[-job]:priority,...] [-X max iterations per job] [-g random seed] [-O megabytes: stream the packed binary matrix from the disk through that much memory per worker] [-E epsilon: stop once the 95%% CI on the top eigen value is narrower]\n");
 		retcode = 1; goto BACK;
 	}
 
@@ -67,30 +143,358 @@ int main(int argc, char *argv[])
 			j += 1;
 			tolerance = atof(argv[j]);
 		}
+		else if (0 == strcmp(argv[j],"-e")){
+			j += 1;
+			if (0 == strcmp(argv[j], "power"))
+				engine = ENGINEPOWER;
+			else if (0 == strcmp(argv[j], "subspace"))
+				engine = ENGINESUBSPACE;
+			else if (0 == strcmp(argv[j], "lanczos"))
+				engine = ENGINELANCZOS;
+			else {
+				printf("unknown engine %s\n", argv[j]); retcode = 1; goto BACK;
+			}
+		}
+		else if (0 == strcmp(argv[j],"-b")){
+			j += 1;
+			batch = atoi(argv[j]); /** jobs advanced together by a worker **/
+			if (batch < 1) batch = 1;
+		}
+		else if (0 == strcmp(argv[j],"-i")){
+			j += 1;
+			if (0 == strcmp(argv[j], "random"))
+				warmstart = WARMRANDOM;
+			else if (0 == strcmp(argv[j], "base"))
+				warmstart = WARMBASE;
+			else if (0 == strcmp(argv[j], "last"))
+				warmstart = WARMLAST;
+			else {
+				printf("unknown starting vectors %s\n", argv[j]); retcode = 1; goto BACK;
+			}
+		}
+		else if (0 == strcmp(argv[j],"-p")){
+			j += 1;
+			if (0 == strcmp(argv[j], "double"))
+				precision = PRECDOUBLE;
+			else if (0 == strcmp(argv[j], "float"))
+				precision = PRECFLOAT;
+			else if (0 == strcmp(argv[j], "bf16"))
+				precision = PRECBF16;
+			else {
+				printf("unknown precision %s\n", argv[j]); retcode = 1; goto BACK;
+			}
+		}
+		else if (0 == strcmp(argv[j],"-k")){
+			j += 1;
+			krylov = atoi(argv[j]); /** Lanczos basis size **/
+		}
+		else if (0 == strcmp(argv[j],"-o")){
+			j += 1;
+			resultfile = argv[j]; /** eigen vectors and perturbations of every job, see sink.h **/
+		}
+		else if (0 == strcmp(argv[j],"-N")){
+			j += 1;
+			if (0 == strcmp(argv[j], "compact"))
+				placement = PLACECOMPACT;
+			else if (0 == strcmp(argv[j], "scatter"))
+				placement = PLACESCATTER;
+			else if (0 == strcmp(argv[j], "none"))
+				placement = PLACENONE;
+			else {
+				printf("unknown placement %s\n", argv[j]); retcode = 1; goto BACK;
+			}
+		}
+		else if (0 == strcmp(argv[j],"-J")){
+			j += 1;
+			probefile = argv[j]; /** probe report as JSON, see probe.h **/
+		}
+		else if (0 == strcmp(argv[j],"-C")){
+			j += 1;
+			checkpointfile = argv[j]; /** see checkpoint.h **/
+		}
+		else if (0 == strcmp(argv[j],"-I")){
+			j += 1;
+			checkpointinterval = atof(argv[j]);
+		}
+		else if (0 == strcmp(argv[j],"-B")){
+			j += 1;
+			budget = atof(argv[j]); /** wall clock seconds per job, see scheduler.h **/
+		}
+		else if (0 == strcmp(argv[j],"-D")){
+			j += 1;
+			deadline = atof(argv[j]); /** the run stops that many seconds after it starts **/
+		}
+		else if (0 == strcmp(argv[j],"-P")){
+			j += 1;
+			priorities = argv[j];
+		}
+		else if (0 == strcmp(argv[j],"-g")){
+			j += 1;
+			seed = (unsigned int) strtoul(argv[j], NULL, 10); /** job k draws the same numbers in every run with this seed, see random.h **/
+		}
+		else if (0 == strcmp(argv[j],"-v")){
+			verbose = 1; /** the results of every job on the console even with -o **/
+		}
+		else if (0 == strcmp(argv[j],"-E")){
+			j += 1;
+			epsilon = atof(argv[j]); /** stop rule, see aggregate.h **/
+		}
+		else if (0 == strcmp(argv[j],"-O")){
+			j += 1;
+			streammegabytes = atof(argv[j]); /** out of core, see stream.h **/
+		}
+		else if (0 == strcmp(argv[j],"-X")){
+			j += 1;
+			maxiterations = atoi(argv[j]);
+		}
+		else if (0 == strcmp(argv[j],"-S")){
+			j += 1;
+			socketpath = argv[j];
+		}
+		else if (0 == strcmp(argv[j],"-M")){
+			j += 1;
+			if (servedcount == DAEMONMAXMATRICES) {
+				printf("at most %d matrices can be served\n", DAEMONMAXMATRICES); retcode = 1; goto BACK;
+			}
+			served[servedcount++] = argv[j];
+		}
+		else if (0 == strcmp(argv[j],"-R")){
+			j += 1;
+			window = atoi(argv[j]); /** rows of the rolling window, see rolling.h **/
+		}
+		else if (0 == strcmp(argv[j],"-T")){
+			j += 1;
+			teamsize = atoi(argv[j]);
+		}
+		else if (0 == strcmp(argv[j],"-m")){
+			j += 1;
+			if (0 == strcmp(argv[j], "shared"))
+				sharedmatrix = 1;
+			else if (0 == strcmp(argv[j], "private"))
+				sharedmatrix = 0;
+			else {
+				printf("unknown matrix mode %s\n", argv[j]); retcode = 1; goto BACK;
+			}
+		}
 		else{
 			printf("bad option %s\n", argv[j]); retcode = 1; goto BACK;
 		}
 	}
 
-	printf("will use scale %g and quantity %d: %d workers, %d eigen values, tolerance: %g\n", scale, quantity, numworkers, r, tolerance);
+	printf("will use scale %g and quantity %d: %d workers, %d eigen values, tolerance: %g, engine: %s\n", scale, quantity, numworkers, r, tolerance,
+			engine == ENGINESUBSPACE ? "subspace" : engine == ENGINELANCZOS ? "lanczos" : "power");
+
+	config.r = r;
+	config.scale = scale;
+	config.tolerance = tolerance;
+	config.engine = engine;
+	config.krylov = krylov;
+	config.warmstart = warmstart;
+	config.basevector = NULL;
+	config.precision = precision;
+	config.lowmatrix = NULL;
+	config.factor = NULL;
+	config.streamfile = NULL;
+	config.streambytes = 0;
+	if (batch > 1 && engine != ENGINEPOWER) {
+		printf(" --> batching is only done by the power engine, reset batch to 1\n");
+		batch = 1;
+	}
+	config.sharedmatrix = sharedmatrix;
+	config.batch = batch;
+	/** with time limits the scheduler stops the jobs, the iteration cap is only there if asked for **/
+	if (maxiterations <= 0)
+		maxiterations = budget > 0 || deadline > 0 ? INT_MAX : SCHEDMAXITERATIONS;
+	config.maxiterations = maxiterations;
+	config.seed = seed;
+	config.psched = NULL;
+
+	KRNinit(); /** select the matvec kernel before any thread starts **/
+	printf("matvec kernel: %s\n", KRNisaname(KRNisa()));
+
+	if (window > 0) {
+		/** the -w threads all work on the solve of the day, there are no perturbed jobs **/
+		if (resultfile != NULL || warmstart != WARMRANDOM || quantity != 1 || streammegabytes > 0)
+			printf(" --> -o, -i, -q and -O are not used by the rolling mode\n");
+		pthread_mutex_init(&outputmutex, NULL);
+		retcode = PWRtrack(argv[1], window, &config, numworkers, &stopping, &outputmutex);
+		goto BACK;
+	}
 
-	if ( numworkers > quantity ){
-		numworkers = quantity;
-		printf(" --> reset workers to %d\n", numworkers);
+	if (socketpath != NULL) {
+		/** the -w workers stay up and take their jobs from the clients **/
+		served[0] = argv[1];
+		if (streammegabytes > 0)
+			printf(" --> -O is not used by the server, the matrices are held in memory\n");
+		pthread_mutex_init(&outputmutex, NULL);
+		retcode = PWRserve(socketpath, served, servedcount, &config, numworkers, &stopping, &outputmutex);
+		goto BACK;
 	}
 
-	deadstatus = (char *) calloc(numworkers, sizeof(char));
+	/** the deadline counts from here, loading included **/
+	PWRschedinit(&scheduler, budget, deadline);
+	if (budget > 0 || deadline > 0) {
+		config.psched = &scheduler;
+		printf("scheduler: %g s per job, deadline in %g s, at most %d iterations per job\n", budget, deadline, maxiterations);
+	}
+
+	loadstart = PWRseconds();
+	if (streammegabytes > 0) {
+		/** out of core: only the header is read here, every worker streams the data at each product **/
+		retcode = PWRstreamprobe(argv[1], &n, &streamchecksum);
+		config.streamfile = argv[1];
+		config.streambytes = (size_t)(streammegabytes*1048576.0);
+	}
+	else
+		retcode = PWRreadmodel(argv[1], &n, &covmatrix, &k, &factors); /** read the data once **/
+	if (retcode != 0)
+		goto BACK;
+	loadseconds = PWRseconds() - loadstart;
+	printf("load time: %.6f s\n", loadseconds);
+	matrixcount = KRNpackedsize(n);
+	if (config.streamfile != NULL) {
+		if (precision != PRECDOUBLE || placement != PLACENONE || teamsize > 1 || warmstart == WARMBASE)
+			printf(" --> -p, -N, -T and -i base are not used out of core\n");
+		precision = PRECDOUBLE;
+		config.precision = PRECDOUBLE;
+		placement = PLACENONE;
+		teamsize = 1;
+		if (warmstart == WARMBASE) {
+			warmstart = WARMRANDOM;
+			config.warmstart = WARMRANDOM;
+		}
+	}
+	if (factors != NULL) {
+		/** every product is O(n k), the dense matrix is never formed **/
+		FACinit(&factor, n, k, factors);
+		config.factor = &factor;
+		matrixcount = FACcount(n, k);
+		printf("factor model: k = %d, %.3f MB instead of %.1f MB for the packed matrix\n", k,
+				matrixcount*sizeof(double)/1048576.0, KRNpackedsize(n)*sizeof(double)/1048576.0);
+		if (precision != PRECDOUBLE || placement != PLACENONE || teamsize > 1)
+			printf(" --> -p, -N and -T are not used with a factor model\n");
+		precision = PRECDOUBLE;
+		config.precision = PRECDOUBLE;
+		placement = PLACENONE;
+		teamsize = 1;
+	}
+
+	if ((retcode = AGGinit(&aggregate, n, r, epsilon))) {
+		printf("could not create the aggregate\n"); goto BACK;
+	}
+
+	if (checkpointfile != NULL) {
+		/** out of core the checksum is the one of the file header, the same data **/
+		if ((retcode = PWRckpinit(&checkpoint, n, r, quantity, scale, seed, factors ? factors : covmatrix, config.streamfile ? 0 : matrixcount)))
+			goto BACK;
+		if (config.streamfile != NULL)
+			checkpoint.matrixchecksum = streamchecksum;
+		if ((retcode = PWRckpload(&checkpoint, checkpointfile)))
+			goto BACK;
+		for (j = 0; j < quantity; j++)
+			if (checkpoint.status[j] == JOBDONE) {
+				/** reported again so that the output covers every job **/
+				for (batchcount = 0; batchcount < r; batchcount++)
+					printf("Job %d: Eigenvalue #%d estimate: %.12e\n", j, batchcount+1, checkpoint.eigenvalue[(size_t)j*r + batchcount]);
+				AGGadd(&aggregate, &checkpoint.eigenvalue[(size_t)j*r], NULL);
+				++earlier;
+			}
+	}
+
+	priority = (int *)calloc(quantity, sizeof(int));
+	if (!priority) {
+		printf("could not create priority array\n"); retcode = NOMEMORY; goto BACK;
+	}
+	if (priorities != NULL && (retcode = PWRschedpriorities(priorities, quantity, priority)))
+		goto BACK;
+
+	/** the batches: consecutive jobs of the same priority, or with a checkpoint its interrupted jobs
+	 * one by one (they go on from their iterates) and batches of the jobs it does not have **/
+	pjob = (powerjob *)calloc(quantity, sizeof(powerjob));
+	if (!pjob) {
+		printf("could not create job array\n"); retcode = NOMEMORY; goto BACK;
+	}
+	numbatches = 0;
+	for (j = 0; j < quantity; j++) {
+		status = checkpointfile != NULL ? checkpoint.status[j] : JOBPENDING;
+		if (status == JOBINTERRUPTED) {
+			pjob[numbatches].jobnumber = j;
+			pjob[numbatches].count = 1;
+			pjob[numbatches].resume = checkpoint.state[j];
+			pjob[numbatches].priority = priority[j];
+			pjob[numbatches++].seed = checkpoint.seed[j];
+		}
+		else if (status == JOBPENDING) {
+			if (numbatches > 0 && pjob[numbatches - 1].resume == NULL && pjob[numbatches - 1].count < batch
+					&& pjob[numbatches - 1].jobnumber + pjob[numbatches - 1].count == j && pjob[numbatches - 1].priority == priority[j])
+				++pjob[numbatches - 1].count;
+			else {
+				pjob[numbatches].jobnumber = j;
+				pjob[numbatches].priority = priority[j];
+				pjob[numbatches++].count = 1;
+			}
+		}
+	}
+	/** the queue is FIFO: the urgent batches are pushed first **/
+	if (priorities != NULL)
+		qsort(pjob, numbatches, sizeof(powerjob), &comparejobs);
+	if (checkpointfile != NULL)
+		printf("checkpoint %s: %d jobs done earlier, %d batches to run\n", checkpointfile, earlier, numbatches);
+	if (numbatches == 0) {
+		AGGreport(&aggregate);
+		printf("summary: n %d jobs 0 of %d workers 0 threads 0 load %.6f s solve 0.000000 s iterations 0 matvecs 0 matrixbytes %ld\n",
+				n, quantity, loadseconds, (long)(matrixcount*sizeof(double)));
+		goto BACK;
+	}
+
+	/** scheduling: -w threads in all. With at least as many queued batches as threads every
+	 * thread runs its own jobs; with fewer, and jobs large enough, the threads are grouped
+	 * in teams that split each job (see team.c) instead of sitting idle **/
+	if (teamsize <= 0) {
+		teamsize = 1;
+		if (n >= TEAMMINN && numbatches < numworkers)
+			teamsize = numworkers/numbatches;
+	}
+	if (teamsize > numworkers)
+		teamsize = numworkers;
+	numworkers /= teamsize;
+	if ( numworkers > numbatches ){
+		numworkers = numbatches;
+		printf(" --> reset workers to %d\n", numworkers);
+	}
+	config.teamsize = teamsize;
+	printf("scheduler: %d workers, %d threads per job (n = %d, %d batches queued)\n", numworkers, teamsize, n, numbatches);
 
 	pthread_mutex_init(&outputmutex, NULL); /** common to everybody **/
 
+	if (precision != PRECDOUBLE) {
+		/** iterations read a rounded copy shared by everybody, the double matrix is kept for refinement **/
+		lowmatrix = PWRlowermatrix(n, covmatrix, precision);
+		if (lowmatrix == NULL) {
+			printf("could not create the %s matrix\n", KRNprecisionname(precision)); retcode = NOMEMORY; goto BACK;
+		}
+		config.lowmatrix = lowmatrix;
+		printf("matrix stored in %s for the iterations: %.1f MB instead of %.1f MB\n", KRNprecisionname(precision),
+				PWRlowercount(n, precision)*sizeof(double)/1048576.0, KRNpackedsize(n)*sizeof(double)/1048576.0);
+	}
+
+	if (warmstart == WARMBASE) {
+		/** unperturbed eigen vectors, computed once and read by every worker **/
+		if ((retcode = PWRsolvebase(n, covmatrix, &config, &stopping, &outputmutex, &basevector)))
+			goto BACK;
+		config.basevector = basevector;
+	}
 
-	psyncmutex = (pthread_mutex_t *)calloc(numworkers, sizeof(pthread_mutex_t));
-	if(!psyncmutex){
-		printf("could not create mutex array\n"); retcode = NOMEMORY; goto BACK;
+	/** every batch of jobs is queued up front, the queue never blocks the master **/
+	if(PWRqueueinit(&jobqueue, numbatches, 1) || PWRqueueinit(&donequeue, numbatches, numworkers)){
+		printf("could not create job queues\n"); retcode = NOMEMORY; goto BACK;
 	}
 
-	for(j = 0; j < numworkers; j++)
-		pthread_mutex_init(&psyncmutex[j], NULL);
+	if (resultfile != NULL) {
+		if ((retcode = PWRsinkopen(&sink, resultfile, n, r, scale, numbatches)))
+			goto BACK;
+		printf("results written to %s by the result sink\n", resultfile);
+	}
 
 	ppbag = (powerbag **)calloc(numworkers, sizeof(powerbag *));
 	if(!ppbag){
@@ -100,174 +504,226 @@ int main(int argc, char *argv[])
 	ppbagproxy = ppbag;
 
 	pthread = (pthread_t *)calloc(numworkers, sizeof(pthread_t));
-	if(!pthread){
+	pstart = (workerstart *)calloc(numworkers, sizeof(workerstart));
+	if(!pthread || !pstart){
 		printf("could not create thread array\n"); retcode = NOMEMORY; goto BACK;
 	}
 
+	/** with a placement, the matrices are copied once per node and every worker gets the copy of its node **/
+	matrixreplica[0] = covmatrix;
+	lowreplica[0] = lowmatrix;
+	if (placement != PLACENONE) {
+		if ((retcode = PWRtopologyinit(&topology, placement)))
+			goto BACK;
+		if ((retcode = PWRreplicate(&topology, covmatrix, KRNpackedsize(n), matrixreplica))
+				|| (lowmatrix && (retcode = PWRreplicate(&topology, lowmatrix, PWRlowercount(n, precision), lowreplica)))) {
+			printf("could not replicate the matrix on every node\n"); goto BACK;
+		}
+		printf("placement: %s over %d cpus and %d nodes, matrix %s\n", placement == PLACECOMPACT ? "compact" : "scatter",
+				topology.ncpus, topology.nnodes, topology.nnodes > 1 ? "replicated on every node" : "not replicated");
+		pthread_barrier_init(&ready, NULL, numworkers + 1);
+	}
 
-	retcode = PWRreadnload(argv[1], &n, &covmatrix); /** read the data once **/
-	if (retcode != 0)
-		goto BACK;
-
+	residentbefore = PWRresidentbytes();
 	for(j = 0; j < numworkers; j++) {
+		pstart[j].ID = j;
+		pstart[j].n = n;
+		pstart[j].config = config;
+		pstart[j].ppbag = &ppbag[j];
+		pstart[j].pjobs = &jobqueue;
+		pstart[j].pdone = &donequeue;
+		pstart[j].poutputmutex = &outputmutex;
+		node = 0;
+		if (placement != PLACENONE) {
+			pstart[j].ptopo = &topology;
+			pstart[j].firstcpu = j*teamsize;
+			pstart[j].pready = &ready;
+			node = topology.node[pstart[j].firstcpu % topology.ncpus];
+		}
+		pstart[j].matrix = matrixreplica[node];
+		pstart[j].config.lowmatrix = lowreplica[node];
 
-		if((retcode = PWRallocatebag(j, n, r, covmatrix, &ppbag[j], scale, tolerance, &psyncmutex[j], &outputmutex)))
+		if(placement == PLACENONE && (retcode = PWRallocatebag(j, n, covmatrix, &config, &ppbag[j], &jobqueue, &donequeue, &stopping, &outputmutex)))
 			goto BACK;
+	}
 
+	solvestart = PWRseconds();
+	for(j = 0; j < numworkers; j++) {
 		printf("about to launch thread for worker %d\n", j);
 
-		pthread_create(&pthread[j], NULL, &PWR_wrapper, (void *) ppbag[j]);
+		pthread_create(&pthread[j], NULL, &PWR_wrapper, (void *) &pstart[j]);
 	}
-
-	initialruns = numworkers;
-	if (initialruns > quantity) initialruns = quantity;
-
-	for(theworker = 0; theworker < initialruns; theworker++){
-		pbag = ppbag[theworker];
-		/**retcode = cheap_rank1perturb(n, pbag->scratch, pbag->matcopy, pbag->matrix, &rseed, scale);
-		if (retcode != 0)
-			goto BACK;**/
-
-		pthread_mutex_lock(&outputmutex);
-		printf("*****master:  worker %d will run experiment %d\n", theworker, j);
-		pthread_mutex_unlock(&outputmutex);
-
-		/** tell the worker to work **/
-		pthread_mutex_lock(&psyncmutex[theworker]);
-		pbag->command = WORK;
-		pbag->status = WORKING;
-		pbag->jobnumber = theworker;
-		pbag->itercount = 0;
-		pthread_mutex_unlock(&psyncmutex[theworker]);
-
+	if (placement != PLACENONE) {
+		/** the bags are being allocated by their workers **/
+		pthread_barrier_wait(&ready);
+		pthread_barrier_destroy(&ready);
+		for(j = 0; j < numworkers; j++)
+			if (pstart[j].retcode) {
+				/** the workers with a bag quit at their first job, the others are already gone **/
+				printf("worker %d could not allocate its bag\n", j);
+				retcode = pstart[j].retcode;
+				stopping = 1;
+			}
 	}
-	scheduledjobs = activeworkers = initialruns;
-
-	while(activeworkers > 0) {
-		/** check the workers' status **/
-		gotone = 0;
-		for(theworker = 0; theworker < numworkers; theworker++){
-
-			pthread_mutex_lock(&psyncmutex[theworker]);
-			pbag = ppbag[theworker];
-			if(pbag->status == DONEWITHWORK){
-
-				pthread_mutex_lock(&outputmutex);
-				printf("master:  worker %d is done with job %d\n", pbag->ID, pbag->jobnumber);
+	printf("resident memory: %.1f MB before bags, %.1f MB after, %.3f MB per worker (%s matrix)\n",
+			residentbefore/1048576.0, PWRresidentbytes()/1048576.0,
+			(PWRresidentbytes() - residentbefore)/1048576.0/numworkers, sharedmatrix ? "shared" : "private");
+	if (retcode == 0)
+		printf("arena: %.3f MB per worker on %s pages\n", ppbag[0]->arena.size/1048576.0, PWRarenapagesname(ppbag[0]->arena.pages));
+
+	/** hand out the jobs: workers pull them as they become free **/
+	for(j = 0; j < numbatches; j++)
+		PWRqueuepush(&jobqueue, &pjob[j]);
+	PWRqueueclose(&jobqueue); /** workers leave once it is drained **/
+
+	/** collect results, the master sleeps until a worker pushes one; the queue is closed
+	 * when the last worker leaves, so this also ends when the run is interrupted **/
+	while((presult = (powerresult *) PWRqueuepop(&donequeue)) != NULL){
+		/** the accounting is the master's alone, no lock needed **/
+		for (batchcount = 0; batchcount < presult->count; batchcount++) {
+			totaliterations += presult->iterations[batchcount];
+			totalmatvecs += presult->matvecs[batchcount];
+			donejobs += !presult->interrupted;
+			if (!presult->interrupted)
+				AGGadd(&aggregate, &presult->eigenvalue[batchcount*r], &presult->eigenvector[(size_t)batchcount*r*n]);
+		}
+		interrupted |= presult->interrupted;
+		if (!aggregate.stopped && AGGdone(&aggregate)) {
+			/** enough jobs for the interval asked for, the running ones finish **/
+			aggregate.stopped = 1;
+			dropped = PWRqueuedrain(&jobqueue);
+			pthread_mutex_lock(&outputmutex);
+			printf("aggregate: 95%% CI on eigenvalue #1 is %.6e wide after %ld jobs, below %g: %d batches dropped\n",
+					AGGwidth(&aggregate.value[0]), aggregate.value[0].count, epsilon, dropped);
+			pthread_mutex_unlock(&outputmutex);
+		}
+		/** with -o the eigen values and vectors are in the result file, the console only gets them with -v **/
+		if (resultfile == NULL || verbose) {
+			pthread_mutex_lock(&outputmutex);
+			for (batchcount = 0; batchcount < presult->count; batchcount++) {
+				printf("master:  worker %d is done with job %d after %d iterations (%d matvecs, %d on the double matrix)%s\n", presult->ID, presult->jobnumber + batchcount,
+						presult->iterations[batchcount], presult->matvecs[batchcount],
+						precision == PRECDOUBLE ? presult->matvecs[batchcount] : presult->refined[batchcount],
+						presult->interrupted ? " (interrupted)" : "");
 				for (j = 0; j < r; j++) {
-					printf("Job %d: Eigenvalue #%d estimate: %.12e\n", pbag->jobnumber, j+1, pbag->eigenvalue[j]);
-				}
-				/**for (j = 0; j < r; j++) {
-					printf("Eigenvector #%d: ", j+1);
-					PWRshowvector(n, &pbag->eigenvector[j*n]);
-				} don't print the eigen vectors they take much room**/
-				pthread_mutex_unlock(&outputmutex);
-
-				if(scheduledjobs >= quantity){
-					/** tell worker to quit **/
-					pthread_mutex_lock(&outputmutex);
-					printf("master: telling worker %d to quit\n", pbag->ID);
-					pthread_mutex_unlock(&outputmutex);
-					pbag->command = QUIT;
-					pbag->status = QUIT;
-					--activeworkers;
+					printf("Job %d: Eigenvalue #%d estimate: %.12e\n", presult->jobnumber + batchcount, j+1, presult->eigenvalue[batchcount*r + j]);
 				}
-				else {
-					gotone = 1;
-				}
-			}
-			else if(pbag->status == PREANYTHING) {
-				pthread_mutex_lock(&outputmutex);
-				printf("master:  worker %d is available\n", theworker);
-				pthread_mutex_unlock(&outputmutex);
-				gotone = 1;
 			}
-			else if( (pbag->status == WORKING) && (pbag->itercount > 100000)){
-				pbag->command = INTERRUPT;
-				pthread_mutex_lock(&outputmutex);
-				printf("master: telling worker %d to interrupt\n", pbag->ID);
-				pthread_mutex_unlock(&outputmutex);
-			}
-			else if(deadstatus[theworker]){
-				pthread_mutex_lock(&outputmutex);
-				printf("master: telling worker %d to quit\n", pbag->ID);
-				pthread_mutex_unlock(&outputmutex);
-				pbag->command = QUIT;
-				pbag->status = QUIT;
-				--activeworkers;
-				/** and let's make sure we don't do it again **/
-				deadstatus[theworker] = 0;
-			}
-			pthread_mutex_unlock(&psyncmutex[theworker]);
-			if(gotone) break;
-			usleep(10000);
-
-		}
-		/** at this point we have run through all workers **/
-
-		if(gotone){
-			/** if we are here, "theworker" can work **/
-			pbag = ppbag[theworker];
-			/**retcode = cheap_rank1perturb(n, pbag->scratch, pbag->qcopy, pbag->q, &rseed, scale);
-			if (retcode != 0)
-				goto BACK;**/
-
-			pthread_mutex_lock(&outputmutex);
-			printf("master:  worker %d will run experiment %d\n", theworker, scheduledjobs);
 			pthread_mutex_unlock(&outputmutex);
-
-
-			/** tell the worker to work **/
-			pthread_mutex_lock(&psyncmutex[theworker]);
-			pbag->command = WORK;
-			pbag->status = WORKING;
-			pbag->itercount = 0;
-			pbag->jobnumber = scheduledjobs;
-			pthread_mutex_unlock(&psyncmutex[theworker]);
-
-			++scheduledjobs;
 		}
+		if (checkpointfile != NULL) {
+			/** the results are still ours, the interrupted iterates are copied **/
+			if (PWRckprecord(&checkpoint, presult))
+				printf("no memory to checkpoint job %d\n", presult->jobnumber);
+			if (PWRseconds() - checkpoint.lastwrite > checkpointinterval)
+				PWRckpwrite(&checkpoint, checkpointfile);
+		}
+		/** the vectors go to disk from the writer thread, or straight back to the worker **/
+		if (resultfile == NULL || PWRsinkpush(&sink, presult))
+			PWRreleaseresult(presult);
 	}
 
-
-
-	/*  pthread_mutex_lock(&psynchro_array[theworker]);
-  pbag->command = QUIT;
-  pthread_mutex_unlock(&psynchro_array[theworker]);*/
-
 	pthread_mutex_lock(&outputmutex);
 	printf("master:  done with loop\n");
 	pthread_mutex_unlock(&outputmutex);
 
-	/** actually this is bad -- should wait for the threads to be done --
-      but how **/
 	for(j = 0; j < numworkers; j++){
 		pthread_join(pthread[j], NULL);
 		pthread_mutex_lock(&outputmutex);
 		printf("master: joined with thread %d\n", j);
 		pthread_mutex_unlock(&outputmutex);
+	}
+
+	if (config.psched != NULL) {
+		printf("scheduler: %ld jobs done in %.6f s on average, %ld skipped for the deadline, stopped: %ld over budget, %ld at the deadline, %ld hopeless, %ld at the iteration cap\n",
+				scheduler.jobsdone, scheduler.jobsdone ? scheduler.jobseconds/scheduler.jobsdone : 0, scheduler.dropped,
+				scheduler.stopped[STOPBUDGET], scheduler.stopped[STOPDEADLINE], scheduler.stopped[STOPHOPELESS], scheduler.stopped[STOPITERATIONS]);
+		interrupted |= scheduler.dropped > 0;
+	}
+
+	if (checkpointfile != NULL) {
+		for (j = 0; j < quantity; j++) {
+			ckpdone += checkpoint.status[j] == JOBDONE;
+			ckpinterrupted += checkpoint.status[j] == JOBINTERRUPTED;
+		}
+		if (PWRckpwrite(&checkpoint, checkpointfile) == 0)
+			printf("checkpoint %s: %d jobs done, %d interrupted, %d not started\n", checkpointfile, ckpdone, ckpinterrupted,
+					quantity - ckpdone - ckpinterrupted);
+	}
+
+	if (resultfile != NULL && PWRsinkclose(&sink)) {
+		printf("could not write all the results to %s\n", resultfile);
+		retcode = 1;
+	}
+
+	/** the workers are gone, their probes can be read **/
+#ifdef PWRPROBE
+	{
+		pwrprobe **probes = (pwrprobe **)calloc(numworkers, sizeof(pwrprobe *)); /** every bag exists if retcode is 0 **/
+
+		if (probes != NULL && retcode == 0) {
+			for(j = 0; j < numworkers; j++)
+				probes[j] = ppbag[j]->pprobe;
+			PRBreport(probes, numworkers);
+			if (probefile != NULL && PRBwritejson(probefile, probes, numworkers) == 0)
+				printf("probe: written to %s\n", probefile);
+			free(probes);
+		}
+	}
+#else
+	if (probefile != NULL)
+		printf(" --> built without PWRPROBE, no probe report for %s\n", probefile);
+#endif
+
+	for(j = 0; j < numworkers; j++){
 		pbag = ppbag[j];
 		PWRfreebag(&pbag);
 	}
 	free(ppbag);
+	ppbag = NULL;
+	solveseconds = PWRseconds() - solvestart;
+
+	AGGreport(&aggregate);
+
+	/** one line for scripts and rpowerbench: the matrix bytes are those streamed by one matvec **/
+	printf("summary: n %d jobs %d of %d workers %d threads %d load %.6f s solve %.6f s iterations %ld matvecs %ld matrixbytes %ld%s\n",
+			n, donejobs, quantity, numworkers, numworkers*teamsize, loadseconds, solveseconds, totaliterations, totalmatvecs,
+			(long)(precision == PRECDOUBLE ? matrixcount*sizeof(double) : PWRlowercount(n, precision)*sizeof(double)),
+			interrupted ? " interrupted" : "");
 
 	BACK:
-	if (covmatrix != NULL) {
-		free(covmatrix); covmatrix = NULL;
+	PWRsinkclose(&sink);
+	/** with a single node the replica is the matrix itself **/
+	for (node = 0; topology.nnodes > 1 && node < topology.nnodes; node++) {
+		PWRfreematrix(&matrixreplica[node], KRNpackedsize(n));
+		PWRfreematrix(&lowreplica[node], PWRlowercount(n, precision));
 	}
+	PWRtopologyfree(&topology);
+	PWRckpfree(&checkpoint);
+	PWRschedfree(&scheduler);
+	AGGfree(&aggregate);
+	free(priority);
+	free(pstart);
+	PWRqueuedestroy(&jobqueue);
+	PWRqueuedestroy(&donequeue);
+	free(pjob);
+	PWRfreematrix(&basevector, (size_t)r*n);
+	PWRfreematrix(&lowmatrix, PWRlowercount(n, precision));
+	PWRfreematrix(&covmatrix, KRNpackedsize(n));
+	PWRfreematrix(&factors, FACcount(n, k));
 	return retcode;
 }
 
 
 
-int cheap_rank1perturb(int n, double *scratch, double *matcopy, double *matrix, unsigned int* pseed, double scale)
+/** draw the perturbation vector s of the job, the perturbed matrix Q + s s^T is never formed (see operator.c) **/
+int cheap_rank1perturb(int n, double *scratch, unsigned int seed, unsigned int job, double scale)
 {
-	int retcode = 0, j, i;
+	int retcode = 0, j;
 	double sum2, invnorm;
 
 	/** first, create a random vector **/
-	for(j = 0; j < n; j++)
-		scratch[j] = ((double) rand_r(pseed))/((double) RAND_MAX);
+	RNGuniform(seed, job, RNGPERTURBATION, 0, n, scratch);
 
 	/** next, convert to norm 1 **/
 	sum2 = 0;
@@ -284,32 +740,38 @@ int cheap_rank1perturb(int n, double *scratch, double *matcopy, double *matrix,
 
 	printf("scale for random perturbation: %g\n", scale);
 
-	for(i = 0; i < n; i++)
-		for(j = 0; j < n; j++)
-			matrix[i*n + j] = scratch[i]*scratch[j] + matcopy[i*n + j];
-
 	return retcode;
 }
 
-void *PWR_wrapper(void *pvoidedbag)
+void *PWR_wrapper(void *pvoidedstart)
 {
-	powerbag *pbag = (powerbag *) pvoidedbag;
+	workerstart *pstart = (workerstart *) pvoidedstart;
+
+	if (pstart->ptopo != NULL) {
+		/** the team helpers started by PWRpoweralg inherit the cpus of the worker **/
+		if (PWRpin(pstart->ptopo, pstart->firstcpu, pstart->config.teamsize))
+			printf("worker %d could not be pinned\n", pstart->ID);
+		pstart->retcode = PWRallocatebag(pstart->ID, pstart->n, pstart->matrix, &pstart->config, pstart->ppbag,
+				pstart->pjobs, pstart->pdone, &stopping, pstart->poutputmutex);
+		pthread_barrier_wait(pstart->pready);
+		if (pstart->retcode) {
+			PWRqueuedetach(pstart->pdone);
+			return NULL;
+		}
+	}
 
-	PWRpoweralg(pbag);
+	PWRpoweralg(*pstart->ppbag);
 
-	return (void *) &pbag->ID;
+	return (void *) &pstart->ID;
 }
 
 
 
 void handlesigint(int signal)
 {
-	int j;
 	printf("yo, what's happening\n");
-	for(j = 0; j < numworkersproxy; j++){
-		deadstatus[j] = 1;
-	}
-	/** brutal **/
+	stopping = 1;
+	/** brutal: running jobs stop at their next iteration, queued ones are dropped **/
 }
 
 
@@ -0,0 +1,738 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "matio.h"
+#include "covariance.h"
+#include "factor.h"
+#include "arena.h"
+
+#define PARSECHUNK (1 << 16) /** smallest piece of text given to a parser thread **/
+#define NOTOKEN ((size_t) -1)
+
+static size_t pageround(size_t bytes)
+{
+	size_t page = sysconf(_SC_PAGESIZE);
+
+	return (bytes + page - 1)/page*page;
+}
+
+/** zeroed page aligned storage for count doubles, mapped on its own so that it can later be
+ * sealed read only with PWRsealmatrix, and released by PWRfreematrix like a mapped file
+ * **/
+double *PWRallocmatrix(size_t count)
+{
+	void *address;
+
+	address = mmap(NULL, pageround(count*sizeof(double)), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (address == MAP_FAILED)
+		return NULL;
+	/** every sweep reads it all, fewer TLB misses with transparent huge pages **/
+	if (count*sizeof(double) >= ARENAHUGEPAGE)
+		madvise(address, pageround(count*sizeof(double)), MADV_HUGEPAGE);
+
+	return (double *) address;
+}
+
+/** make a matrix from PWRallocmatrix read only, any write after this point faults **/
+int PWRsealmatrix(double *matrix, size_t count)
+{
+	return mprotect(matrix, pageround(count*sizeof(double)), PROT_READ);
+}
+
+/** make a sealed matrix from PWRallocmatrix writable again, for an update in place; it is sealed
+ * again with PWRsealmatrix once done, and nobody may read it in between
+ * **/
+int PWRunsealmatrix(double *matrix, size_t count)
+{
+	return mprotect(matrix, pageround(count*sizeof(double)), PROT_READ | PROT_WRITE);
+}
+
+/** free a matrix from PWRallocmatrix, sealed or not, or from a mapped binary file **/
+void PWRfreematrix(double **pmatrix, size_t count)
+{
+	if (*pmatrix == NULL) return;
+
+	munmap(*pmatrix, pageround(count*sizeof(double)));
+	*pmatrix = NULL;
+}
+
+/** size of a packed matrix stored in the given precision, in doubles as PWRfreematrix wants it **/
+size_t PWRlowercount(int n, int precision)
+{
+	return (KRNpackedsize(n)*KRNprecisionbytes(precision) + sizeof(double) - 1)/sizeof(double);
+}
+
+/** copy of the packed matrix rounded to float or bf16 (see KRNlower), sealed read only like the
+ * double matrix and shared the same way; free with PWRfreematrix and PWRlowercount
+ * **/
+double *PWRlowermatrix(int n, const double *packed, int precision)
+{
+	double *low = PWRallocmatrix(PWRlowercount(n, precision));
+
+	if (low == NULL)
+		return NULL;
+	KRNlower(precision, KRNpackedsize(n), packed, low);
+	PWRsealmatrix(low, PWRlowercount(n, precision));
+
+	return low;
+}
+
+/** FNV-1a over 64 bit words, folded so that every bit of a word reaches the low bits
+ * bytes is a multiple of 8 for our files, a trailing part is hashed byte by byte
+ * **/
+uint64_t PWRchecksum(uint64_t hash, const void *data, size_t bytes)
+{
+	const unsigned char *p = (const unsigned char *) data;
+	uint64_t word;
+	size_t i;
+
+	for (i = 0; i + sizeof(word) <= bytes; i += sizeof(word)) {
+		memcpy(&word, &p[i], sizeof(word));
+		hash = (hash ^ word)*1099511628211ULL;
+		hash ^= hash >> 32;
+	}
+	for (; i < bytes; i++)
+		hash = (hash ^ p[i])*1099511628211ULL;
+
+	return hash;
+}
+
+static int readall(int fd, void *buffer, size_t bytes, off_t offset)
+{
+	ssize_t got;
+	char *p = (char *) buffer;
+
+	while (bytes > 0) {
+		got = pread(fd, p, bytes, offset);
+		if (got <= 0)
+			return 1;
+		p += got;
+		bytes -= got;
+		offset += got;
+	}
+
+	return 0;
+}
+
+/** returns of a MATRETURNS file into malloc storage, they are demeaned in place later **/
+static int readbinaryreturns(char *filename, int fd, pwrmatheader *pheader, off_t filesize, int *prows, double **preturns)
+{
+	int retcode = 0, T = 0, n = (int) pheader->n;
+	double *returns = NULL;
+
+	if (pheader->rows == 0 || pheader->rows > 100000000 || pheader->rows*pheader->n > (uint64_t) SIZE_MAX/sizeof(double)) {
+		printf("%s: bad number of observations %llu\n", filename, (unsigned long long) pheader->rows); retcode = 1; goto BACK;
+	}
+	T = (int) pheader->rows;
+	if (pheader->databytes != (uint64_t)T*n*sizeof(double) || pheader->dataoffset < sizeof(pwrmatheader)
+			|| pheader->dataoffset + pheader->databytes > (uint64_t) filesize) {
+		printf("%s: data size %llu at offset %llu does not match %d x %d returns and a file of %lld bytes\n", filename,
+				(unsigned long long) pheader->databytes, (unsigned long long) pheader->dataoffset, T, n, (long long) filesize);
+		retcode = 1; goto BACK;
+	}
+	returns = (double *)malloc(pheader->databytes);
+	if (returns == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	if (readall(fd, returns, pheader->databytes, pheader->dataoffset)) {
+		printf("cannot read data of %s\n", filename); retcode = 1; goto BACK;
+	}
+	if (PWRchecksum(MATCHECKSUMSEED, returns, pheader->databytes) != pheader->checksum) {
+		printf("%s: checksum mismatch, the file is corrupted\n", filename); retcode = 1; goto BACK;
+	}
+	printf("read binary returns file %s: T = %d, n = %d\n", filename, T, n);
+
+	BACK:
+	if (retcode != 0) {
+		free(returns);
+		returns = NULL;
+	}
+	*prows = T;
+	*preturns = returns;
+	return retcode;
+}
+
+/** factor model of a MATFACTORS file, into sealed PWRallocmatrix storage **/
+static int readbinaryfactors(char *filename, int fd, pwrmatheader *pheader, off_t filesize, int *pk, double **pfactors)
+{
+	int retcode = 0, k = 0, n = (int) pheader->n;
+	size_t count = 0;
+	double *factors = NULL;
+
+	if (pheader->rows == 0 || pheader->rows > pheader->n) {
+		printf("%s: bad number of factors %llu\n", filename, (unsigned long long) pheader->rows); retcode = 1; goto BACK;
+	}
+	k = (int) pheader->rows;
+	count = FACcount(n, k);
+	if (pheader->databytes != count*sizeof(double) || pheader->dataoffset < sizeof(pwrmatheader)
+			|| pheader->dataoffset + pheader->databytes > (uint64_t) filesize) {
+		printf("%s: data size %llu at offset %llu does not match n = %d, k = %d and a file of %lld bytes\n", filename,
+				(unsigned long long) pheader->databytes, (unsigned long long) pheader->dataoffset, n, k, (long long) filesize);
+		retcode = 1; goto BACK;
+	}
+	factors = PWRallocmatrix(count);
+	if (factors == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	if (readall(fd, factors, pheader->databytes, pheader->dataoffset)) {
+		printf("cannot read data of %s\n", filename); retcode = 1; goto BACK;
+	}
+	if (PWRchecksum(MATCHECKSUMSEED, factors, pheader->databytes) != pheader->checksum) {
+		printf("%s: checksum mismatch, the file is corrupted\n", filename); retcode = 1; goto BACK;
+	}
+	PWRsealmatrix(factors, count);
+	printf("read binary factor model file %s: n = %d, k = %d\n", filename, n, k);
+
+	BACK:
+	if (retcode != 0)
+		PWRfreematrix(&factors, count);
+	*pk = k;
+	*pfactors = factors;
+	return retcode;
+}
+
+/** Binary file: the header is checked, then a packed file whose data offset is a multiple of
+ * the page size is mapped read only and used in place. Other files (full storage, odd offsets)
+ * are read into PWRallocmatrix storage. The checksum is verified in both cases.
+ * A returns file goes to *preturns instead, with its number of observations in *prows, a factor
+ * model to *pfactors with its number of factors in *pk.
+ * **/
+static int readbinary(char *filename, int fd, int *pn, double **pmatrix, int *prows, double **preturns, int *pk, double **pfactors)
+{
+	int retcode = 0, n = 0, i, packed;
+	pwrmatheader header;
+	struct stat filestat;
+	size_t count = 0, expected;
+	uint64_t checksum = MATCHECKSUMSEED;
+	double *matrix = NULL, *row = NULL;
+	void *address;
+
+	if (fstat(fd, &filestat) || readall(fd, &header, sizeof(header), 0)) {
+		printf("cannot read header of %s\n", filename); retcode = 1; goto BACK;
+	}
+	if (header.version != MATVERSION || header.byteorder != MATBYTEORDER || header.dtype != MATFLOAT64) {
+		printf("%s: unsupported version %u, byte order %x or dtype %u\n", filename,
+				header.version, header.byteorder, header.dtype);
+		retcode = 1; goto BACK;
+	}
+	if (header.n == 0 || header.n > 1000000) {
+		printf("%s: bad dimension %llu\n", filename, (unsigned long long) header.n); retcode = 1; goto BACK;
+	}
+	n = (int) header.n;
+	if (header.flags & MATRETURNS) {
+		retcode = readbinaryreturns(filename, fd, &header, filestat.st_size, prows, preturns);
+		goto BACK;
+	}
+	if (header.flags & MATFACTORS) {
+		retcode = readbinaryfactors(filename, fd, &header, filestat.st_size, pk, pfactors);
+		goto BACK;
+	}
+	if (!(header.flags & MATSYMMETRIC)) {
+		printf("%s: the matrix is not flagged symmetric\n", filename); retcode = 1; goto BACK;
+	}
+	packed = (header.flags & MATPACKED) != 0;
+	expected = (packed ? KRNpackedsize(n) : (size_t)n*n)*sizeof(double);
+	if (header.databytes != expected || header.dataoffset < sizeof(header)
+			|| header.dataoffset + header.databytes > (uint64_t) filestat.st_size) {
+		printf("%s: data size %llu at offset %llu does not match n = %d and a file of %lld bytes\n", filename,
+				(unsigned long long) header.databytes, (unsigned long long) header.dataoffset, n, (long long) filestat.st_size);
+		retcode = 1; goto BACK;
+	}
+	count = KRNpackedsize(n);
+
+	if (packed && header.dataoffset % sysconf(_SC_PAGESIZE) == 0) {
+		/** zero copy: the pages of the file are the matrix **/
+		address = mmap(NULL, header.databytes, PROT_READ, MAP_PRIVATE, fd, header.dataoffset);
+		if (address == MAP_FAILED) {
+			printf("cannot map %s\n", filename); retcode = 1; goto BACK;
+		}
+		matrix = (double *) address;
+		madvise(matrix, header.databytes, MADV_WILLNEED);
+		checksum = PWRchecksum(checksum, matrix, header.databytes);
+		printf("mapped binary matrix file %s\n", filename);
+	}
+	else {
+		matrix = PWRallocmatrix(count);
+		if (matrix == NULL) {
+			retcode = NOMEMORY; goto BACK;
+		}
+		if (packed) {
+			if (readall(fd, matrix, header.databytes, header.dataoffset)) {
+				printf("cannot read data of %s\n", filename); retcode = 1; goto BACK;
+			}
+			checksum = PWRchecksum(checksum, matrix, header.databytes);
+		}
+		else {
+			row = (double *)malloc(n*sizeof(double));
+			if (row == NULL) {
+				retcode = NOMEMORY; goto BACK;
+			}
+			for (i = 0; i < n; i++) {
+				if (readall(fd, row, n*sizeof(double), header.dataoffset + (off_t)i*n*sizeof(double))) {
+					printf("cannot read data of %s\n", filename); retcode = 1; goto BACK;
+				}
+				checksum = PWRchecksum(checksum, row, n*sizeof(double));
+				memcpy(&matrix[KRNrowoffset(n, i)], &row[i], (n - i)*sizeof(double));
+			}
+		}
+		PWRsealmatrix(matrix, count);
+		printf("read binary matrix file %s (%s storage)\n", filename, packed ? "packed" : "full");
+	}
+
+	if (checksum != header.checksum) {
+		printf("%s: checksum mismatch, the file is corrupted\n", filename); retcode = 1; goto BACK;
+	}
+
+	BACK:
+	free(row);
+	if (retcode != 0)
+		PWRfreematrix(&matrix, count);
+	*pn = n;
+	*pmatrix = matrix;
+	return retcode;
+}
+
+/** one piece of the text, parsed by one thread **/
+typedef struct parseslice{
+	const char *begin, *end; /** holds whole tokens **/
+	size_t first; /** index in the file of its first token **/
+	size_t count; /** number of tokens **/
+	int n;
+	size_t entries; /** n x n, T x n for returns, FACcount(n, k) for a factor model **/
+	int returns; /** matrix receives the entries in file order (returns or factor model) rather than the packed covariance **/
+	double *matrix;
+	size_t bad; /** index of its first malformed token, NOTOKEN if none **/
+	const char *badtoken;
+	double upper, lower, magnitude; /** symmetry test, see parsetokens **/
+}parseslice;
+
+static const char *nexttoken(const char *p, const char *end, const char **ptokenend)
+{
+	while (p < end && isspace((unsigned char) *p))
+		p++;
+	*ptokenend = p;
+	while (*ptokenend < end && !isspace((unsigned char) **ptokenend))
+		(*ptokenend)++;
+	return p;
+}
+
+static void *counttokens(void *pvoidedslice)
+{
+	parseslice *pslice = (parseslice *) pvoidedslice;
+	const char *p = pslice->begin, *tokenend;
+
+	pslice->count = 0;
+	while ((p = nexttoken(p, pslice->end, &tokenend)) < pslice->end) {
+		++pslice->count;
+		p = tokenend;
+	}
+
+	return NULL;
+}
+
+/** Entries below the diagonal are not stored, they are only used for a cheap randomized symmetry
+ * test: both triangles are summed with the same pseudo random weight for a_ij and a_ji, the
+ * two sums only agree up to rounding when the matrix is symmetric.
+ * **/
+static void *parsetokens(void *pvoidedslice)
+{
+	parseslice *pslice = (parseslice *) pvoidedslice;
+	const char *p = pslice->begin, *tokenend;
+	char *stop;
+	int n = pslice->n, i, j, lo, hi;
+	size_t k = pslice->first, nn = pslice->entries;
+	double value, weight;
+
+	pslice->bad = NOTOKEN;
+	pslice->upper = pslice->lower = pslice->magnitude = 0;
+	for (; (p = nexttoken(p, pslice->end, &tokenend)) < pslice->end; p = tokenend, k++) {
+		if (k >= nn) {
+			/** only END may follow the entries, anything after it is ignored **/
+			if (k == nn && (tokenend - p != 3 || strncmp(p, "END", 3)) && pslice->bad == NOTOKEN) {
+				pslice->bad = k; pslice->badtoken = p;
+			}
+			continue;
+		}
+		value = strtod(p, &stop);
+		if (stop != tokenend || !isfinite(value)) {
+			if (pslice->bad == NOTOKEN) {
+				pslice->bad = k; pslice->badtoken = p;
+			}
+			continue;
+		}
+		if (pslice->returns) {
+			pslice->matrix[k] = value;
+			continue;
+		}
+		i = (int)(k/n);
+		j = (int)(k%n);
+		if (j >= i)
+			pslice->matrix[KRNrowoffset(n, i) + j - i] = value;
+		if (i == j)
+			continue;
+		lo = i < j ? i : j;
+		hi = i < j ? j : i;
+		weight = 1.0 + ((lo*40503u + hi*2654435761u) >> 22)/1024.0;
+		if (j > i)
+			pslice->upper += weight*value;
+		else
+			pslice->lower += weight*value;
+		pslice->magnitude += weight*fabs(value);
+	}
+
+	return NULL;
+}
+
+/** reads "<name> <value>" of a header, value in 1..maximum **/
+static const char *readdimension(char *filename, const char *p, const char *end, const char *name, long maximum, long *pvalue)
+{
+	const char *tokenend;
+	char *stop;
+
+	p = nexttoken(p, end, &tokenend);
+	if ((size_t)(tokenend - p) != strlen(name) || strncmp(p, name, tokenend - p)) {
+		printf("%s: expected \"%s\" at the start of the file\n", filename, name); return NULL;
+	}
+	p = nexttoken(tokenend, end, &tokenend);
+	*pvalue = strtol(p, &stop, 10);
+	if (p == tokenend || stop != tokenend || *pvalue <= 0 || *pvalue > maximum) {
+		printf("%s: bad dimension \"%.*s\"\n", filename, (int)(tokenend - p), p); return NULL;
+	}
+
+	return tokenend;
+}
+
+/** Legacy text file "n <n> matrix <n x n entries> END", read at once and parsed by several
+ * threads: the text is cut at whitespace into slices, every thread counts the tokens of its
+ * slice, which gives the index of the first token of every slice, then parses its slice.
+ * Malformed or missing entries are reported with their position.
+ * Returns "T <T> n <n> returns <T x n entries> END" are parsed the same way into *preturns,
+ * a factor model "n <n> k <k> factors <entries> END" into *pfactors.
+ * **/
+static int readtext(char *filename, int fd, int *pn, double **pmatrix, int *prows, double **preturns, int *pk, double **pfactors)
+{
+	int retcode = 0, n = 0, T = 0, k = 0, t, numthreads = 1;
+	struct stat filestat;
+	char *text = NULL, word[16];
+	const char *p, *tokenend, *data, *end, *cut;
+	size_t length = 0, count = 0, total, nn;
+	long value;
+	double *matrix = NULL, *returns = NULL, *factors = NULL, upper = 0, lower = 0, magnitude = 0;
+	parseslice *slices = NULL, *pbad = NULL;
+	pthread_t *threads = NULL;
+
+	if (fstat(fd, &filestat)) {
+		printf("cannot stat %s\n", filename); retcode = 1; goto BACK;
+	}
+	length = filestat.st_size;
+	text = (char *)malloc(length + 1);
+	if (text == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	if (readall(fd, text, length, 0)) {
+		printf("cannot read %s\n", filename); retcode = 1; goto BACK;
+	}
+	text[length] = 0; /** strtod never runs past the end **/
+	end = text + length;
+
+	/** header: n <n> matrix, T <T> n <n> returns, or n <n> k <k> factors **/
+	p = nexttoken(text, end, &tokenend);
+	if (tokenend - p == 1 && *p == 'T') {
+		if ((p = readdimension(filename, p, end, "T", 100000000, &value)) == NULL) {
+			retcode = 1; goto BACK;
+		}
+		T = (int) value;
+	}
+	if ((p = readdimension(filename, p, end, "n", 1000000, &value)) == NULL) {
+		retcode = 1; goto BACK;
+	}
+	n = (int) value;
+	p = nexttoken(p, end, &tokenend);
+	if (!T && tokenend - p == 1 && *p == 'k') {
+		if ((p = readdimension(filename, p, end, "k", n, &value)) == NULL) {
+			retcode = 1; goto BACK;
+		}
+		k = (int) value;
+		p = nexttoken(p, end, &tokenend);
+	}
+	if (T)
+		printf("T = %d, ", T);
+	printf("n = %d", n);
+	if (k)
+		printf(", k = %d", k);
+	printf("\n");
+	snprintf(word, sizeof(word), "%.*s", (int)(tokenend - p), p);
+	if (strcmp(word, T ? "returns" : k ? "factors" : "matrix")) {
+		printf("%s: expected \"%s\" after the dimension\n", filename, T ? "returns" : k ? "factors" : "matrix"); retcode = 1; goto BACK;
+	}
+	data = tokenend;
+	nn = T ? (size_t)T*n : k ? FACcount(n, k) : (size_t)n*n;
+
+	if (T) {
+		returns = (double *)malloc(nn*sizeof(double));
+		if (returns == NULL) {
+			retcode = NOMEMORY; goto BACK;
+		}
+	}
+	else if (k) {
+		count = nn;
+		factors = PWRallocmatrix(count);
+		if (factors == NULL) {
+			retcode = NOMEMORY; goto BACK;
+		}
+	}
+	else {
+		count = KRNpackedsize(n);
+		matrix = PWRallocmatrix(count);
+		if (matrix == NULL) {
+			retcode = NOMEMORY; goto BACK;
+		}
+	}
+
+	numthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if ((size_t) numthreads > (size_t)(end - data)/PARSECHUNK + 1)
+		numthreads = (int)((size_t)(end - data)/PARSECHUNK + 1);
+	if (numthreads < 1)
+		numthreads = 1;
+	slices = (parseslice *)calloc(numthreads, sizeof(parseslice));
+	threads = (pthread_t *)calloc(numthreads, sizeof(pthread_t));
+	if (slices == NULL || threads == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+
+	for (t = 0, cut = data; t < numthreads; t++) {
+		slices[t].begin = cut;
+		cut = t == numthreads - 1 ? end : data + (end - data)*(t + 1)/numthreads;
+		if (cut < slices[t].begin)
+			cut = slices[t].begin;
+		while (cut < end && !isspace((unsigned char) *cut))
+			cut++;
+		slices[t].end = cut;
+		slices[t].n = n;
+		slices[t].entries = nn;
+		slices[t].returns = T > 0 || k > 0;
+		slices[t].matrix = T ? returns : k ? factors : matrix;
+	}
+
+	for (t = 1; t < numthreads; t++)
+		pthread_create(&threads[t], NULL, &counttokens, (void *) &slices[t]);
+	counttokens((void *) &slices[0]);
+	for (t = 1; t < numthreads; t++)
+		pthread_join(threads[t], NULL);
+
+	for (t = 0, total = 0; t < numthreads; t++) {
+		slices[t].first = total;
+		total += slices[t].count;
+	}
+	if (total < nn) {
+		printf("%s: found %zu entries, expected %zu\n", filename, total, nn); retcode = 1; goto BACK;
+	}
+
+	for (t = 1; t < numthreads; t++)
+		pthread_create(&threads[t], NULL, &parsetokens, (void *) &slices[t]);
+	parsetokens((void *) &slices[0]);
+	for (t = 1; t < numthreads; t++)
+		pthread_join(threads[t], NULL);
+
+	for (t = 0; t < numthreads; t++) {
+		if (pbad == NULL && slices[t].bad != NOTOKEN)
+			pbad = &slices[t];
+		upper += slices[t].upper;
+		lower += slices[t].lower;
+		magnitude += slices[t].magnitude;
+	}
+	if (pbad != NULL) {
+		nexttoken(pbad->badtoken, end, &tokenend);
+		if (pbad->bad < nn && k)
+			printf("%s: malformed entry \"%.*s\" at entry %zu of the factor model\n", filename, (int)(tokenend - pbad->badtoken),
+					pbad->badtoken, pbad->bad);
+		else if (pbad->bad < nn)
+			printf("%s: malformed entry \"%.*s\" at row %d column %d\n", filename, (int)(tokenend - pbad->badtoken),
+					pbad->badtoken, (int)(pbad->bad/n), (int)(pbad->bad%n));
+		else
+			printf("%s: expected END after the entries, found \"%.*s\"\n", filename, (int)(tokenend - pbad->badtoken), pbad->badtoken);
+		retcode = 1; goto BACK;
+	}
+	if (T) {
+		printf("parsed text returns file %s with %d threads\n", filename, numthreads);
+		goto BACK;
+	}
+	if (k) {
+		PWRsealmatrix(factors, count);
+		printf("parsed text factor model file %s with %d threads\n", filename, numthreads);
+		goto BACK;
+	}
+	if (fabs(upper - lower) > 1e-10*magnitude)
+		printf("warning: %s does not hold a symmetric matrix, its upper triangle is used\n", filename);
+
+	PWRsealmatrix(matrix, count);
+	printf("parsed text matrix file %s with %d threads\n", filename, numthreads);
+
+	BACK:
+	free(threads);
+	free(slices);
+	free(text);
+	if (retcode != 0) {
+		PWRfreematrix(&matrix, count);
+		PWRfreematrix(&factors, count);
+		free(returns);
+		returns = NULL;
+	}
+	*pn = n;
+	*pmatrix = matrix;
+	*prows = T;
+	*preturns = returns;
+	*pk = k;
+	*pfactors = factors;
+	return retcode;
+}
+
+/** either file format, a covariance into *pmatrix, returns into *preturns (*prows > 0) or a factor
+ * model into *pfactors (*pk > 0)
+ * **/
+static int readfile(char *filename, int *pn, double **pmatrix, int *prows, double **preturns, int *pk, double **pfactors)
+{
+	int retcode = 0, fd;
+	char magic[sizeof(MATMAGIC)];
+
+	*pn = *prows = *pk = 0;
+	*pmatrix = *preturns = *pfactors = NULL;
+	fd = open(filename, O_RDONLY);
+	if(fd < 0){
+		printf("cannot open file %s\n", filename); return 1;
+	}
+
+	if (!readall(fd, magic, sizeof(magic), 0) && !memcmp(magic, MATMAGIC, sizeof(magic)))
+		retcode = readbinary(filename, fd, pn, pmatrix, prows, preturns, pk, pfactors);
+	else
+		retcode = readtext(filename, fd, pn, pmatrix, prows, preturns, pk, pfactors);
+	close(fd);
+
+	return retcode;
+}
+
+/** Changed this function to only read the matrix and n from the file
+ * This function returns the size of the cov matrix in *pn and the matrix as a packed upper
+ * triangle (see kernels.h) in page aligned storage sealed read only; free it with PWRfreematrix
+ * The format, binary or text, is recognized from the first bytes of the file. A returns file
+ * is turned into its covariance on the way, the returns themselves are dropped. A factor model
+ * is refused, see PWRreadmodel.
+ * **/
+int PWRreadnload(char *filename, int *pn, double **pmatrix)
+{
+	int retcode = 0, n = 0, k = 0;
+	double *factors = NULL;
+
+	retcode = PWRreadmodel(filename, &n, pmatrix, &k, &factors);
+	if (retcode == 0 && factors != NULL) {
+		printf("%s holds a factor model, which this mode does not take\n", filename);
+		PWRfreematrix(&factors, FACcount(n, k));
+		retcode = 1;
+	}
+	*pn = n;
+	return retcode;
+}
+
+/** as PWRreadnload, but a factor model is given as it is in *pfactors (sealed, FACcount(n, k)
+ * doubles to free with PWRfreematrix) with *pmatrix NULL
+ * **/
+int PWRreadmodel(char *filename, int *pn, double **pmatrix, int *pk, double **pfactors)
+{
+	int retcode = 0, n = 0, T = 0;
+	double *matrix = NULL, *returns = NULL;
+
+	retcode = readfile(filename, &n, &matrix, &T, &returns, pk, pfactors);
+	if (retcode == 0 && returns != NULL)
+		retcode = PWRcovariance(T, n, returns, 0, &matrix);
+	free(returns);
+
+	if (retcode == 0) {
+		printf("read and loaded data for n = %d with code %d\n", n, retcode);
+	}
+	else {
+		printf("failed to read/load data\n");
+	}
+	*pn = n;
+	*pmatrix = matrix;
+	return retcode;
+}
+
+/** the T x n returns of a returns file, in malloc storage **/
+int PWRreadreturns(char *filename, int *pT, int *pn, double **preturns)
+{
+	int retcode, n = 0, k = 0;
+	double *matrix = NULL, *factors = NULL;
+
+	retcode = readfile(filename, &n, &matrix, pT, preturns, &k, &factors);
+	if (retcode == 0 && *preturns == NULL) {
+		printf("%s holds a %s, not returns\n", filename, factors ? "factor model" : "covariance matrix");
+		PWRfreematrix(&matrix, KRNpackedsize(n));
+		PWRfreematrix(&factors, FACcount(n, k));
+		retcode = 1;
+	}
+	*pn = n;
+	return retcode;
+}
+
+/** header and count doubles of data at MATDATAOFFSET, so that the readers can map it;
+ * rows is T for returns, k for a factor model and 0 for a matrix
+ * **/
+static int writematrix(char *filename, uint32_t flags, int n, int rows, const double *data, size_t count)
+{
+	int retcode = 0;
+	FILE *output = NULL;
+	pwrmatheader header;
+	static const char zeros[MATDATAOFFSET];
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MATMAGIC, sizeof(header.magic));
+	header.version = MATVERSION;
+	header.byteorder = MATBYTEORDER;
+	header.dtype = MATFLOAT64;
+	header.flags = flags;
+	header.n = n;
+	header.rows = rows;
+	header.dataoffset = MATDATAOFFSET;
+	header.databytes = count*sizeof(double);
+	header.checksum = PWRchecksum(MATCHECKSUMSEED, data, header.databytes);
+
+	output = fopen(filename, "wb");
+	if (!output) {
+		printf("cannot open file %s\n", filename); retcode = 1; goto BACK;
+	}
+	if (fwrite(&header, sizeof(header), 1, output) != 1
+			|| fwrite(zeros, 1, MATDATAOFFSET - sizeof(header), output) != MATDATAOFFSET - sizeof(header)
+			|| fwrite(data, sizeof(double), count, output) != count) {
+		printf("cannot write file %s\n", filename); retcode = 1;
+	}
+	if (fclose(output) && retcode == 0) {
+		printf("cannot write file %s\n", filename); retcode = 1;
+	}
+
+	BACK:
+	return retcode;
+}
+
+/** write a packed symmetric matrix in the binary format, PWRreadnload maps it **/
+int PWRwritebinary(char *filename, int n, const double *packed)
+{
+	return writematrix(filename, MATPACKED | MATSYMMETRIC, n, 0, packed, KRNpackedsize(n));
+}
+
+/** write T x n returns in the binary format, flagged MATRETURNS **/
+int PWRwritereturns(char *filename, int T, int n, const double *returns)
+{
+	return writematrix(filename, MATRETURNS, n, T, returns, (size_t)T*n);
+}
+
+/** write a factor model (FACcount(n, k) doubles) in the binary format, flagged MATFACTORS **/
+int PWRwritefactors(char *filename, int n, int k, const double *factors)
+{
+	return writematrix(filename, MATFACTORS, n, k, factors, FACcount(n, k));
+}
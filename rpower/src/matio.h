@@ -0,0 +1,64 @@
+#ifndef MATIO
+#define MATIO
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Covariance matrix storage and files.
+ * Two file formats are read by PWRreadnload, told apart by their first bytes:
+ * - the legacy text format: "n <n> matrix" followed by the n x n entries and "END"
+ * - the binary format below: a fixed header, then the data at a page aligned offset so that
+ *   the file can be mapped read only and used as is by all the workers (no parsing, no copy)
+ * Either may hold a T x n returns matrix instead (T observations of n assets, row major):
+ * "T <T> n <n> returns" followed by the T x n entries and "END", or a binary file flagged
+ * MATRETURNS with T in rows. PWRreadnload then builds the covariance (see covariance.h).
+ * Or a factor model B F B^T + D (see factor.h): "n <n> k <k> factors" followed by the n x k
+ * loadings B (row major), the k x k factor covariance F, the n diagonal entries of D and "END",
+ * or a binary file flagged MATFACTORS with k in rows and the same layout. It is never expanded,
+ * PWRreadmodel gives it as it is.
+ * **/
+
+#define MATMAGIC "RPWRMAT" /** 8 bytes with the terminating 0 **/
+#define MATVERSION 1
+#define MATBYTEORDER 0x01020304 /** written natively, a file from another endianness is refused **/
+#define MATDATAOFFSET 4096 /** data offset of the files we write, a multiple of the usual page size **/
+
+/** dtype of the entries **/
+#define MATFLOAT64 1
+
+/** flags **/
+#define MATPACKED 1 /** packed upper triangle (see kernels.h), else full n x n row major **/
+#define MATSYMMETRIC 2
+#define MATRETURNS 4 /** T x n returns, row major **/
+#define MATFACTORS 8 /** factor model, FACcount(n, k) entries **/
+
+#define MATCHECKSUMSEED 14695981039346656037ULL /** start value of PWRchecksum **/
+
+typedef struct pwrmatheader{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder;
+	uint32_t dtype;
+	uint32_t flags;
+	uint64_t n;
+	uint64_t dataoffset; /** from the start of the file **/
+	uint64_t databytes;
+	uint64_t checksum; /** PWRchecksum of the data from MATCHECKSUMSEED **/
+	uint64_t rows; /** T of a MATRETURNS file, k of a MATFACTORS file, 0 otherwise (and in the first files written) **/
+}pwrmatheader;
+
+double *PWRallocmatrix(size_t count);
+int PWRsealmatrix(double *matrix, size_t count);
+int PWRunsealmatrix(double *matrix, size_t count);
+void PWRfreematrix(double **pmatrix, size_t count);
+size_t PWRlowercount(int n, int precision);
+double *PWRlowermatrix(int n, const double *packed, int precision);
+uint64_t PWRchecksum(uint64_t hash, const void *data, size_t bytes);
+int PWRreadnload(char *filename, int *pn, double **pmatrix);
+int PWRreadreturns(char *filename, int *pT, int *pn, double **preturns);
+int PWRreadmodel(char *filename, int *pn, double **pmatrix, int *pk, double **pfactors);
+int PWRwritebinary(char *filename, int n, const double *packed);
+int PWRwritereturns(char *filename, int T, int n, const double *returns);
+int PWRwritefactors(char *filename, int n, int k, const double *factors);
+
+#endif
@@ -0,0 +1,91 @@
+#include "utilities.h"
+#include "operator.h"
+#include "kernels.h"
+#include "linalg.h"
+#include "team.h"
+
+/** The perturbed and deflated matrices used to be written out in full for every job
+ * (three n^2 sweeps of setup). Here they are applied as the base matvec plus O(n) corrections
+ * per perturbation/deflation term, so a job only needs its vectors.
+ * **/
+
+void OPinit(pwroperator *op, int n, const double *base, double *s, double *lambda, double *w)
+{
+	op->n = n;
+	op->base = base;
+	op->s = s;
+	op->ndeflated = 0;
+	op->lambda = lambda;
+	op->w = w;
+	op->pteam = NULL;
+	op->precision = PRECDOUBLE;
+	op->lowbase = NULL;
+	op->factor = NULL;
+	op->factorwork = NULL;
+	op->stream = NULL;
+}
+
+/** read the matrix from lowbase in the given precision until op->precision is set back to PRECDOUBLE **/
+void OPlowprecision(pwroperator *op, int precision, const void *lowbase)
+{
+	if (lowbase == NULL)
+		precision = PRECDOUBLE;
+	op->precision = precision;
+	op->lowbase = lowbase;
+}
+
+/** Q0 is the factor model, base is not read (NULL); a no-op if factor is NULL **/
+void OPfactor(pwroperator *op, const pwrfactor *factor, double *factorwork)
+{
+	op->factor = factor;
+	op->factorwork = factorwork;
+	if (factor != NULL)
+		op->precision = PRECDOUBLE;
+}
+
+/** Q0 is streamed from the disk, base is not read (NULL); a no-op if stream is NULL **/
+void OPstream(pwroperator *op, pwrstream *stream)
+{
+	op->stream = stream;
+	if (stream != NULL)
+		op->precision = PRECDOUBLE;
+}
+
+/** Y = A X for a block of m vectors (m x n), norm2 (if not NULL) receives the squared column norms **/
+void OPapply(pwroperator *op, int m, double *x, double *y, double *norm2)
+{
+	int c;
+
+	if (op->factor != NULL || op->stream != NULL) {
+		/** O(n k) product, or bound by the disk: the team would not pay off **/
+		if (op->factor != NULL)
+			FACsymm(op->factor, m, x, y, op->factorwork);
+		else
+			PWRstreamsymm(op->stream, m, x, y);
+		for (c = 0; c < m; c++) {
+			OPcorrect(op, &x[(size_t)c*op->n], &y[(size_t)c*op->n]);
+			if (norm2)
+				norm2[c] = LINdot(op->n, &y[(size_t)c*op->n], &y[(size_t)c*op->n]);
+		}
+		return;
+	}
+
+	/** serial KRNsymm + OPcorrect without a team, split across the team otherwise **/
+	PWRteamsymm(op->pteam, op->n, m, op->precision, op->precision == PRECDOUBLE ? op->base : op->lowbase, x, y, op, norm2);
+}
+
+/** y += (s s^T - sum_f lambda_f w_f w_f^T) x, turns y = Q0 x into y = A x
+ * lets callers share one base product between operators that differ only in their corrections
+ * **/
+void OPcorrect(pwroperator *op, double *x, double *y)
+{
+	int n = op->n, f;
+	double *w;
+
+	if (op->s != NULL)
+		LINaxpy(n, LINdot(n, op->s, x), op->s, y);
+	for (f = 0; f < op->ndeflated; f++) {
+		w = &op->w[(size_t)f*n];
+		LINaxpy(n, -op->lambda[f]*LINdot(n, w, x), w, y);
+	}
+}
@@ -0,0 +1,35 @@
+#ifndef OPERATOR
+#define OPERATOR
+
+#include "kernels.h"
+#include "factor.h"
+#include "stream.h"
+
+/** implicit operator (Q0 + s s^T - sum_f lambda_f w_f w_f^T), never materialized
+ * base is the packed covariance, or Q0 is a factor model (factor.h) or streamed from its file
+ * (stream.h), the perturbation and the
+ * deflated pairs are O(n) vectors
+ * **/
+typedef struct pwroperator{
+	int n;
+	const double *base; /** packed upper triangle of Q0, never written **/
+	double *s; /** rank 1 perturbation vector, NULL if none **/
+	int ndeflated; /** number of eigen pairs removed so far **/
+	double *lambda; /** deflated eigen values **/
+	double *w; /** deflated eigen vectors (ndeflated x n) **/
+	struct pwrteam *pteam; /** thread team applying the operator, NULL to do it alone **/
+	int precision; /** storage precision OPapply reads the matrix in, PRECDOUBLE reads base **/
+	const void *lowbase; /** base rounded to a lower precision (PRECFLOAT or PRECBF16), NULL if none **/
+	const pwrfactor *factor; /** Q0 as a factor model instead of base, NULL if none **/
+	double *factorwork; /** 2 k m doubles for a product with m vectors **/
+	pwrstream *stream; /** Q0 read from the disk at every product instead of base, NULL if none **/
+}pwroperator;
+
+void OPinit(pwroperator *op, int n, const double *base, double *s, double *lambda, double *w);
+void OPlowprecision(pwroperator *op, int precision, const void *lowbase);
+void OPfactor(pwroperator *op, const pwrfactor *factor, double *factorwork);
+void OPstream(pwroperator *op, pwrstream *stream);
+void OPapply(pwroperator *op, int m, double *x, double *y, double *norm2);
+void OPcorrect(pwroperator *op, double *x, double *y);
+
+#endif
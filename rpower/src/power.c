@@ -2,19 +2,82 @@
 #include <unistd.h>
 #include "utilities.h"
 #include "power.h"
+#include "kernels.h"
+#include "team.h"
+#include "linalg.h"
 
-int cheap_rank1perturb(int n, double *scratch, double *matcopy, double *qprime, unsigned int* pseed, double scale);
+int cheap_rank1perturb(int n, double *scratch, unsigned int seed, unsigned int job, double scale);
 
 
+/** result with room for a batch of b jobs, in a single zeroed block **/
+static powerresult *newresult(powerbag *pbag, int n, int r, int b)
+{
+	powerresult *presult;
+
+	presult = (powerresult *)calloc(1, sizeof(powerresult) + ((size_t)b*r*n + (size_t)b*n + (size_t)b*r)*sizeof(double) + 4*b*sizeof(int));
+	if (presult == NULL)
+		return NULL;
+
+	presult->eigenvector = (double *)(presult + 1);
+	presult->perturbation = presult->eigenvector + (size_t)b*r*n;
+	presult->eigenvalue = presult->perturbation + (size_t)b*n;
+	presult->iterations = (int *)(presult->eigenvalue + (size_t)b*r);
+	presult->matvecs = presult->iterations + b;
+	presult->refined = presult->matvecs + b;
+	presult->seed = (unsigned int *)(presult->refined + b);
+	presult->n = n;
+	presult->r = r;
+	presult->owner = pbag;
+
+	return presult;
+}
+
+/** the bag computes into presult from now on **/
+static void fillresult(powerbag *pbag, powerresult *presult)
+{
+	pbag->presult = presult;
+	pbag->vector = presult->eigenvector;
+	pbag->scratch = presult->perturbation;
+	pbag->eigenvalue = presult->eigenvalue;
+	pbag->iterations = presult->iterations;
+	pbag->matvecs = presult->matvecs;
+	pbag->refined = presult->refined;
+	pbag->seed = presult->seed;
+}
+
+/** give a result back to the worker that made it, called by any thread **/
+void PWRreleaseresult(powerresult *presult)
+{
+	powerbag *pbag = presult->owner;
+
+	pthread_mutex_lock(&pbag->freemutex);
+	presult->next = pbag->freeresults;
+	pbag->freeresults = presult;
+	pthread_mutex_unlock(&pbag->freemutex);
+}
+
 /** free memory of a bag**/
 void PWRfreebag(powerbag **ppbag)
 {
 	powerbag *pbag = *ppbag;
+	powerresult *presult;
 
 	if (pbag == NULL) goto BACK;
 
-	PWRfree((void**)&pbag->vector0);
-	PWRfree((void**)&pbag->qcopy);
+	/** every result handed off has been released by now **/
+	free(pbag->presult);
+	while ((presult = pbag->freeresults) != NULL) {
+		pbag->freeresults = presult->next;
+		free(presult);
+	}
+	pthread_mutex_destroy(&pbag->freemutex);
+
+	if (pbag->ownsqcopy)
+		PWRfreematrix(&pbag->qcopy, KRNpackedsize(pbag->n));
+	if (pbag->stream != NULL)
+		PWRstreamclose(pbag->stream, pbag->ID);
+	/** vectors, operators, the stream and the probe **/
+	PWRarenafree(&pbag->arena);
 	PWRfree((void**)&pbag);
 
 	BACK:
@@ -28,7 +91,6 @@ void PWRfree(void **paddress)
 
 	if (address == NULL) goto BACK;
 
-	printf("freeing array at %p\n", address);
 	free(address);
 	address = NULL; /** prevents double freeing **/
 
@@ -36,49 +98,129 @@ void PWRfree(void **paddress)
 	*paddress = address;
 }
 
-int PWRallocatebag(int ID, int n, int r, double *covmatrix, powerbag **ppbag, double scale, double tolerance, pthread_mutex_t *psyncmutex, pthread_mutex_t *poutputmutex)
+/** resident set size of the process in bytes, from /proc/self/statm **/
+long PWRresidentbytes(void)
+{
+	long pages = 0, resident = 0;
+	FILE *statm = fopen("/proc/self/statm", "r");
+
+	if (statm == NULL) return 0;
+	if (fscanf(statm, "%ld %ld", &pages, &resident) != 2)
+		resident = 0;
+	fclose(statm);
+
+	return resident*sysconf(_SC_PAGESIZE);
+}
+
+/** offsets in the arena of the buffers of a bag, see PWRallocatebag **/
+typedef struct baglayout{
+	size_t vector0, newvector, blockx, blocky, smallwork, lowbest, factorwork;
+	size_t ints; /** batchslot, batchlevel, lowstall **/
+	size_t batchop, krylovwork, stream, probe, lastvector;
+}baglayout;
+
+/** covmatrix is the packed matrix from PWRreadnload, either referenced (shared mode) or copied **/
+int PWRallocatebag(int ID, int n, double *covmatrix, powerconfig *pconfig, powerbag **ppbag, pwrqueue *pjobs, pwrqueue *pdone, volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex)
 {
 	int retcode = 0;
-	int i;
+	int r = pconfig->r, b = pconfig->batch;
 	powerbag *pbag = NULL;
-	double *double_array = NULL;
+	pwrarena *parena;
 
-	int status, command;
-	double *vector, *vector0, *newvector, *q, *qprime, *qcopy, *scratch, *eigenvalue;
+	double *vector0 = NULL, *newvector = NULL, *qcopy = NULL, *smallwork = NULL;
+	double *blockx = NULL, *blocky = NULL, *krylovwork = NULL, *lowbest = NULL;
+	int *int_array = NULL, krylov = 0;
+	size_t factorwork = pconfig->factor ? 2*(size_t)pconfig->factor->k*(b > r ? b : r) : 0;
+	baglayout at;
+	pwroperator *batchop = NULL;
+	powerresult *presult = NULL;
 
 	pbag = (powerbag *)calloc(1, sizeof(powerbag));
 	if (pbag == NULL) {
 		printf("cannot allocate bag for ID %d\n", ID);
 		retcode = NOMEMORY; goto BACK;
 	}
+	pthread_mutex_init(&pbag->freemutex, NULL);
+	parena = &pbag->arena;
+
+	if (pconfig->engine == ENGINELANCZOS) {
+		/** basis of m + 1 vectors, m restart vectors, three m x m matrices and m Ritz values **/
+		krylov = pconfig->krylov > 0 ? pconfig->krylov : (2*r + 10 > 20 ? 2*r + 10 : 20);
+		if (krylov < r + 1)
+			krylov = r + 1;
+		if (krylov > n)
+			krylov = n;
+	}
 
-	status = PREANYTHING;
-	command = STANDBY;
-
-	double_array = calloc(n*r + n*r + n*r + n*n + n*n, sizeof(double));
-	if (double_array == NULL) {
-		retcode = NOMEMORY; goto BACK;
+	/** the perturbed and deflated matrices are applied implicitly (see operator.c), only vectors are needed
+	 * there are b job slots, slot s uses the r x n blocks at offset s*n*r of vector0, vector and newvector;
+	 * vector, the perturbations and the outputs of the slots are in the current result (see powerresult).
+	 * Everything the worker computes with is in its arena, laid out once for all its jobs **/
+	at.vector0 = PWRarenaslot(parena, (size_t)b*n*r*sizeof(double));
+	at.newvector = PWRarenaslot(parena, (size_t)b*n*r*sizeof(double));
+	at.blockx = PWRarenaslot(parena, (size_t)b*n*sizeof(double));
+	at.blocky = PWRarenaslot(parena, (size_t)b*n*sizeof(double));
+	at.smallwork = PWRarenaslot(parena, 2*(size_t)r*r*sizeof(double));
+	at.lowbest = PWRarenaslot(parena, b*sizeof(double));
+	at.factorwork = PWRarenaslot(parena, factorwork*sizeof(double));
+	at.ints = PWRarenaslot(parena, 3*b*sizeof(int)); /** batchslot, batchlevel, lowstall **/
+	at.batchop = PWRarenaslot(parena, b*sizeof(pwroperator));
+	at.krylovwork = PWRarenaslot(parena, krylov ? ((2*(size_t)krylov + 1)*n + 3*krylov*krylov + krylov)*sizeof(double) : 0);
+	at.stream = PWRarenaslot(parena, pconfig->streamfile ? sizeof(pwrstream) : 0);
+	at.lastvector = PWRarenaslot(parena, pconfig->warmstart == WARMLAST ? (size_t)b*n*r*sizeof(double) : 0);
+#ifdef PWRPROBE
+	at.probe = PWRarenaslot(parena, sizeof(pwrprobe));
+#endif
+	if ((retcode = PWRarenamap(parena))) {
+		printf("cannot map the %.1f MB arena of ID %d\n", parena->size/1048576.0, ID);
+		goto BACK;
 	}
 
-	/** keep variables used for intensive computations close together in memory for more efficiency **/
-	vector0 = &double_array[0];
-	vector = &double_array[n*r];
-	newvector = &double_array[n*r + n*r];
-	qprime = &double_array[n*r + n*r + n*r];
-	q = &double_array[n*r + n*r + n*r + n*n];
-
-	/** now, allocate an extra matrix and a vector to use in perturbation **/
-	/** should really do it in the power retcode since we are putting them in the bag **/
-	qcopy = (double *)calloc(n*n, sizeof(double));
-	scratch = (double *)calloc(n, sizeof(double));
-	if ((qcopy == NULL) || (scratch == NULL)) {
+	vector0 = (double *) PWRarenaat(parena, at.vector0);
+	newvector = (double *) PWRarenaat(parena, at.newvector);
+	blockx = (double *) PWRarenaat(parena, at.blockx);
+	blocky = (double *) PWRarenaat(parena, at.blocky);
+	smallwork = (double *) PWRarenaat(parena, at.smallwork);
+	lowbest = (double *) PWRarenaat(parena, at.lowbest);
+	int_array = (int *) PWRarenaat(parena, at.ints);
+	batchop = (pwroperator *) PWRarenaat(parena, at.batchop);
+	if (krylov)
+		krylovwork = (double *) PWRarenaat(parena, at.krylovwork);
+	if (pconfig->warmstart == WARMLAST)
+		pbag->lastvector = (double *) PWRarenaat(parena, at.lastvector);
+#ifdef PWRPROBE
+	pbag->pprobe = (pwrprobe *) PWRarenaat(parena, at.probe);
+	PRBreset(pbag->pprobe, ID);
+#endif
+
+	/** now, allocate the first result, its perturbation vectors start at zero, and the matrix unless it is shared **/
+	presult = newresult(pbag, n, r, b);
+	if (pconfig->factor != NULL) {
+		/** the factor model is small and read only, no copy and no packed matrix **/
+		pbag->factor = pconfig->factor;
+		pbag->factorwork = (double *) PWRarenaat(parena, at.factorwork);
+	}
+	else if (pconfig->streamfile != NULL) {
+		/** Q0 stays on the disk, the bag only holds the buffers of its stream **/
+		if ((retcode = PWRstreamopen((pwrstream *) PWRarenaat(parena, at.stream), pconfig->streamfile, pconfig->streambytes, pstop)))
+			goto BACK;
+		pbag->stream = (pwrstream *) PWRarenaat(parena, at.stream);
+	}
+	else if (pconfig->sharedmatrix) {
+		/** nothing writes into Q0 any more, every bag can read the same copy **/
+		qcopy = covmatrix;
+	}
+	else {
+		qcopy = PWRallocmatrix(KRNpackedsize(n));
+		if (qcopy != NULL) {
+			/** and copy the covariance matrix **/
+			memcpy(qcopy, covmatrix, KRNpackedsize(n)*sizeof(double));
+			PWRsealmatrix(qcopy, KRNpackedsize(n));
+		}
+	}
+	if ((qcopy == NULL && pconfig->factor == NULL && pbag->stream == NULL) || (presult == NULL)) {
 		retcode = NOMEMORY; goto BACK;
 	}
-	/** and copy the covariance matrix **/
-	for(i = 0; i < n*n; i++)
-		qcopy[i] = covmatrix[i];
-
-	eigenvalue = (double*)calloc(n, sizeof(double));
 
 	BACK:
 	if (pbag != NULL) {
@@ -86,21 +228,39 @@ int PWRallocatebag(int ID, int n, int r, double *covmatrix, powerbag **ppbag, do
 		pbag->ID = ID;
 		pbag->n = n;
 		pbag->r = r;
-		pbag->command = command;
-		pbag->status = status;
-		pbag->q = q;
-		pbag->qprime = qprime;
-		pbag->psynchro = psyncmutex;
+		pbag->pjobs = pjobs;
+		pbag->pdone = pdone;
+		pbag->pstop = pstop;
+		pbag->maxiterations = pconfig->maxiterations;
+		pbag->psched = pconfig->psched;
+		pbag->teamsize = pconfig->teamsize;
 		pbag->poutputmutex = poutputmutex;
 		pbag->qcopy = qcopy;
-		pbag->scratch = scratch;
-		pbag->scale = scale;
-		pbag->eigenvalue = eigenvalue;
-		pbag->vector = vector;
+		pbag->ownsqcopy = qcopy != NULL && qcopy != covmatrix;
+		if (presult != NULL)
+			fillresult(pbag, presult);
+		pbag->scale = pconfig->scale;
 		pbag->vector0 = vector0;
 		pbag->newvector = newvector;
-		pbag->rseed = ID; /** initialize a random seed for the thread using its ID **/
-		pbag->tolerance = tolerance;
+		pbag->rseed = pconfig->seed;
+		pbag->tolerance = pconfig->tolerance;
+		pbag->engine = pconfig->engine;
+		pbag->smallwork = smallwork;
+		pbag->batch = b;
+		pbag->batchcount = 1;
+		pbag->blockx = blockx;
+		pbag->blocky = blocky;
+		pbag->batchslot = int_array;
+		pbag->batchlevel = int_array ? &int_array[b] : NULL;
+		pbag->lowstall = int_array ? &int_array[2*b] : NULL;
+		pbag->lowbest = lowbest;
+		pbag->precision = pconfig->lowmatrix ? pconfig->precision : PRECDOUBLE;
+		pbag->lowmatrix = pconfig->lowmatrix;
+		pbag->krylov = krylov;
+		pbag->warmstart = pconfig->warmstart;
+		pbag->basevector = pconfig->basevector;
+		pbag->krylovwork = krylovwork;
+		pbag->batchop = batchop;
 	}
 	if (retcode != 0) {
 		/** an error occured, cleanup **/
@@ -111,85 +271,73 @@ int PWRallocatebag(int ID, int n, int r, double *covmatrix, powerbag **ppbag, do
 	return retcode;
 }
 
-/** Changed this function to only read the matrix and n from the file
- * This function returns the size of the cov matrix in *pn and the matrix (n*n)
- *
+/** Solve the unperturbed problem once with the Lanczos engine. Its r eigen vectors are returned in
+ * sealed memory shared by all the workers (free with PWRfreematrix, r*n entries) and seed the
+ * perturbed jobs when warm starting with WARMBASE.
  * **/
-int PWRreadnload(char *filename, int *pn, double **pmatrix)
+int PWRsolvebase(int n, double *covmatrix, powerconfig *pconfig, volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex, double **pbasevector)
 {
-	int retcode = 0, n, j;
-	FILE *input = NULL;
-	char buffer[100];
-	double *matrix = NULL;
-
-	input = fopen(filename, "r");
-	if(!input){
-		printf("cannot open file %s\n", filename); retcode = 1; goto BACK;
-	}
-	fscanf(input,"%s", buffer);
-	fscanf(input,"%s", buffer);
-	n = atoi(buffer);
-	printf("n = %d\n", n);
-
-
-	matrix = (double*)calloc(n*n, sizeof(double));
-	if (matrix == NULL) {
-		retcode = NOMEMORY;
+	int retcode = 0, j, r = pconfig->r;
+	powerconfig baseconfig = *pconfig;
+	powerbag *pbag = NULL;
+	double *basevector = NULL;
+
+	baseconfig.engine = ENGINELANCZOS;
+	baseconfig.batch = 1;
+	baseconfig.teamsize = 1;
+	baseconfig.sharedmatrix = 1;
+	baseconfig.warmstart = WARMRANDOM;
+	baseconfig.psched = NULL; /** not a job, no time limit **/
+	if ((retcode = PWRallocatebag(-1, n, covmatrix, &baseconfig, &pbag, NULL, NULL, pstop, poutputmutex)))
 		goto BACK;
+
+	/** scratch is zero: Q = Q0 **/
+	pbag->batchcount = 1;
+	pbag->seed[0] = pbag->rseed;
+	RNGuniform(pbag->rseed, 0, RNGBASE, 0, n, pbag->vector0);
+	if (PWRlanczos(pbag)) {
+		printf("base problem interrupted\n"); retcode = 1; goto BACK;
 	}
 
-	fscanf(input, "%s", buffer);
-	for(j = 0; j < n*n; j++){
-		fscanf(input,"%s", buffer);
-		matrix[j] = atof(buffer);
+	basevector = PWRallocmatrix((size_t)r*n);
+	if (basevector == NULL) {
+		retcode = NOMEMORY; goto BACK;
 	}
+	memcpy(basevector, pbag->vector, (size_t)r*n*sizeof(double));
+	PWRsealmatrix(basevector, (size_t)r*n);
 
-	fclose(input);
+	printf("base problem solved in %d matvecs:", pbag->matvecs[0]);
+	for (j = 0; j < r; j++)
+		printf(" %.12e", pbag->eigenvalue[j]);
+	printf("\n");
 
 	BACK:
-	if (retcode == 0) {
-		printf("read and loaded data for n = %d with code %d\n", n, retcode);
-	}
-	else {
-		PWRfree((void**)&matrix);
-		printf("failed to read/load data\n");
-	}
-	*pn = n;
-	*pmatrix = matrix;
+	PWRfreebag(&pbag);
+	*pbasevector = basevector;
 	return retcode;
 }
 
-
-
-/** Compute a power method iteration **/
+/** Compute a power method iteration
+ * newvector receives the normalized Q' * vector; vector is left untouched so that the caller
+ * can swap the two pointers instead of copying newvector back into vector.
+ * Q' is the implicit perturbed and deflated operator.
+ * **/
 void PWRpoweriteration(int ID, int k, 
-		int n, double *vector, double *newvector, double *q,
+		int n, double *vector, double *newvector, pwroperator *op,
 		double *peigenvalue, double *perror,
 		pthread_mutex_t *poutputmutex)
 {
-	double norm2 = 0, mult, error;
-	int i, j;
-
-	/** w_k+1 = Q * w_k **/
-	for(i = 0; i < n; i++){
-		newvector[i] = 0;
-		for (j = 0; j < n; j++) {
-			newvector[i] += vector[j]*q[i*n + j];
-		}
-	}
+	double norm2, mult, error;
 
-	norm2 = 0;
-	for(j = 0; j < n; j++)
-		norm2 += newvector[j]*newvector[j];
+	/** w_k+1 = Q' * w_k, the norm comes out of the same call **/
+	OPapply(op, 1, vector, newvector, &norm2);
 
 	mult = 1.0/sqrt(norm2);
 
-	for(j = 0; j < n; j++)
-		newvector[j] = newvector[j]*mult;
-
 	*peigenvalue = 1.0/mult;
 
-	PWRcompute_error(n, &error, newvector, vector);
+	/** normalize and compute the error in a single pass **/
+	error = PWRteamscale_error(op->pteam, n, mult, newvector, vector);
 
 	if(0 == k%100){
 		pthread_mutex_lock(poutputmutex);
@@ -198,10 +346,6 @@ void PWRpoweriteration(int ID, int k,
 		pthread_mutex_unlock(poutputmutex);
 	}
 
-	/** will need to map newvector into vector if not terminated **/
-	for(j = 0; j < n; j++)
-		vector[j] = newvector[j];
-
 	*perror = error;
 }
 
@@ -222,165 +366,370 @@ void PWRcompute_error(int n, double *perror, double *newvector, double *vector)
 
 }
 
-/** power method algorithm **/
-void PWRpoweralg(powerbag *pbag)
+/** tell whether the current job has to stop: too many iterations, the run is being killed, or the
+ * scheduler gives up on it (out of time, or not converging fast enough); error is the one the engine
+ * drives below the tolerance
+ * **/
+int PWRcheckinterrupt(powerbag *pbag, int k, double error)
+{
+	pbag->itercount = k;  /** well, in this case we don't really need k **/
+	if (*pbag->pstop)
+		pbag->stopreason = STOPSIGNAL;
+	else if (k > pbag->maxiterations)
+		pbag->stopreason = STOPITERATIONS;
+	else if (pbag->psched != NULL)
+		pbag->stopreason = PWRschedcheck(pbag->psched, &pbag->progress, k, error, pbag->tolerance);
+
+	if (pbag->stopreason != STOPNONE) {
+		pthread_mutex_lock(pbag->poutputmutex);
+		printf(" ID %d interrupting job %d after %d iterations (%s", pbag->ID, pbag->jobnumber, k, PWRschedreason(pbag->stopreason));
+		if (pbag->stopreason == STOPHOPELESS && pbag->progress.estimate >= 0)
+			printf(", %.3f s more needed", pbag->progress.estimate);
+		printf(", error %g)\n", error);
+		pthread_mutex_unlock(pbag->poutputmutex);
+	}
+
+	return pbag->stopreason != STOPNONE;
+}
+
+/** low precision phase of a pair: returns 1 once its error is below the tolerance or has not improved
+ * for PRECSTALL iterations, the rounding of the matrix keeping it from going much lower
+ * **/
+int PWRlowphasedone(double error, double tolerance, double *pbest, int *pstall)
+{
+	if (error < *pbest) {
+		*pbest = error;
+		*pstall = 0;
+	}
+	else
+		++*pstall;
+
+	return error < tolerance || *pstall >= PRECSTALL;
+}
+
+/** refinement of a pair found on the low precision matrix: power iterations on op with the double
+ * matrix, from x until the error is below the tolerance; y is scratch and the refined vector ends in x
+ * returns the number of iterations
+ * **/
+int PWRrefine(powerbag *pbag, pwroperator *op, double *x, double *y, double *peigenvalue, double *perror)
+{
+	int k, precision = op->precision, n = pbag->n;
+	double *start = x, *swap;
+
+	PRBPHASE(pbag->pprobe, PHASEREFINE);
+	op->precision = PRECDOUBLE;
+	for (k = 1; ; k++) {
+		PWRpoweriteration(pbag->ID, k, n, x, y, op, peigenvalue, perror, pbag->poutputmutex);
+		swap = x; x = y; y = swap;
+		if (*perror < pbag->tolerance || k >= pbag->maxiterations || *pbag->pstop)
+			break;
+	}
+	if (x != start)
+		memcpy(start, x, n*sizeof(double));
+	op->precision = precision;
+	PRBPHASE(pbag->pprobe, PHASEITERATE);
+
+	return k;
+}
+
+/** Set w'_0 = w_0 - (w^T w_0) w: starting vector of pair f+1 once pair f has converged **/
+void PWRnextstart(int n, int f, double *vector, double *vector0)
+{
+	int j;
+	double sp;
+
+	/** first compute sp = (w^T w_0)**/
+	sp = 0.0;
+	for (j = 0; j < n; j++) {
+		sp += vector[f*n + j] * vector0[f*n + j];
+	}
+	/** Set w'_0 = w_0 - sp * w **/
+	for (j = 0; j < n; j++) {
+		vector0[(f+1)*n + j] = vector0[f*n + j] - sp * vector[f*n + j];
+	}
+}
+
+/** power method with deflation on the perturbed matrix, one eigen pair after the other
+ * returns 1 if the job was interrupted
+ * **/
+int PWRpowermethod(powerbag *pbag)
 {
 	int n, r, ID;
-	int i, j, f;
-	double *vector, *vector0, *newvector;
-	int k, waitcount, retcode;
-	double error, tolerance, sp;
-	char letsgo = 0, interrupting, forcedquit = 0;
+	int j, f, k, stall, lowdone, refined;
+	double *vector, *vector0, *newvector, *current, *next, *swap;
+	double error, tolerance, best;
+	char interrupting = 0;
+	pwroperator op;
 
 	ID = pbag->ID;
 	n = pbag->n;
 	r = pbag->r;
-	interrupting = 0;
-
-	pthread_mutex_lock(pbag->poutputmutex);
-	printf("ID %d starts\n", pbag->ID);
-	pthread_mutex_unlock(pbag->poutputmutex);
-
-
 	vector = pbag->vector;
 	vector0 = pbag->vector0;
 	newvector = pbag->newvector;
-
 	tolerance = pbag->tolerance;
 
+	/** Q' = Q + s s^T, deflated pairs are appended to the operator as they converge **/
+	OPinit(&op, n, pbag->qcopy, pbag->scratch, pbag->eigenvalue, vector);
+	op.pteam = pbag->pteam;
+	OPlowprecision(&op, pbag->precision, pbag->lowmatrix);
+	OPfactor(&op, pbag->factor, pbag->factorwork);
+	OPstream(&op, pbag->stream);
+	pbag->iterations[0] = 0;
+	pbag->refined[0] = 0;
+
+	for (f = 0; f < r; f++) {
+		best = HUGE_VAL;
+		stall = 0;
+		/** copy f-th column vector0 into vector **/
+		for(j = 0; j < n; j++){
+			vector[f*n + j] = vector0[f*n + j];
+		}
+		current = &vector[f*n];
+		next = &newvector[f*n];
+		for(k = 0; ; k++) {
+
+			/* PWRshowvector(n, current);*/
+			PWRpoweriteration(ID, k, n, current, next, &op, &pbag->eigenvalue[f], &error, pbag->poutputmutex);
+			/** the new iterate becomes the current one, no copy needed **/
+			swap = current; current = next; next = swap;
+			++pbag->iterations[0];
+			lowdone = op.precision == PRECDOUBLE || PWRlowphasedone(error, tolerance, &best, &stall);
+			if (lowdone && op.precision != PRECDOUBLE) {
+				/** good enough on the low precision matrix, finish on the double one **/
+				refined = PWRrefine(pbag, &op, current, next, &pbag->eigenvalue[f], &error);
+				pbag->iterations[0] += refined;
+				pbag->refined[0] += refined;
+			}
+			if(lowdone && error < tolerance){
+				/** finished to compute f-th eigen value **/
+				if (current != &vector[f*n])
+					memcpy(&vector[f*n], current, n*sizeof(double));
 
-	for(;;){
-		pthread_mutex_lock(pbag->poutputmutex);
-		printf(" ID %d in big loop\n", pbag->ID);
-		pthread_mutex_unlock(pbag->poutputmutex);
-
-		letsgo = 0;
-		waitcount = 0;
-		while(letsgo == 0){
-			/** wait until WORK signal **/
-			usleep(10000);
+				/** Set Q' = Q' - lambda w w^T **/
+				op.ndeflated = f + 1;
 
-			pthread_mutex_lock(pbag->psynchro);
-			if(pbag->command == WORK){
-				letsgo = 1;
-			}
-			else if(pbag->command == QUIT)
-				letsgo = 2;
-			pthread_mutex_unlock(pbag->psynchro);
+				if (f < r-1 && !pbag->warm)
+					PWRnextstart(n, f, vector, vector0);
 
-			if (letsgo == 2)
-				goto DONE;
 
-			if(0 == waitcount%20){
 				pthread_mutex_lock(pbag->poutputmutex);
-				printf("ID %d bag %p: wait %d for signal; right now have %d\n", pbag->ID, (void *) pbag, waitcount, pbag->command);
+				printf(" ID %d converged to tolerance %g! on job %d at iteration %d\n", ID, tolerance, pbag->jobnumber, k);
+				printf(" ID %d %d-th eigenvalue:  %g!\n", ID, f, pbag->eigenvalue[f]);
 				pthread_mutex_unlock(pbag->poutputmutex);
 
+				break;
 			}
-			++waitcount;
-
+			if ((interrupting = PWRcheckinterrupt(pbag, k, error)))
+				break; /** takes you outside of for loop **/
 		}
+		if (interrupting) {
+			if (current != &vector[f*n])
+				memcpy(&vector[f*n], current, n*sizeof(double));
+			break; /** takes you outside of for loop **/
+		}
+	}
 
-		pthread_mutex_lock(pbag->poutputmutex);
-		printf("ID %d: got signal to start working\n", pbag->ID);
-		pthread_mutex_unlock(pbag->poutputmutex);
+	return interrupting;
+}
 
-		/** let's do the perturbation here **/
-		/** Q is initialized from qcopy at this line **/
-		if((retcode = cheap_rank1perturb(n, pbag->scratch, pbag->qcopy, pbag->q, &pbag->rseed, pbag->scale)))
-			goto DONE;
+/** take the result of the current batch from the bag, which goes on with one given back by the
+ * master or the sink, or a new one; returns NULL if there is no memory for it
+ * **/
+static powerresult *handresult(powerbag *pbag, int interrupted)
+{
+	powerresult *presult = pbag->presult, *pnext;
+
+	pthread_mutex_lock(&pbag->freemutex);
+	pnext = pbag->freeresults;
+	if (pnext != NULL)
+		pbag->freeresults = pnext->next;
+	pthread_mutex_unlock(&pbag->freemutex);
+	if (pnext == NULL && (pnext = newresult(pbag, pbag->n, pbag->r, pbag->batch)) == NULL)
+		return NULL;
+
+	presult->ID = pbag->ID;
+	presult->jobnumber = pbag->jobnumber;
+	presult->count = pbag->batchcount;
+	presult->interrupted = interrupted;
+	presult->next = NULL;
+	if (pbag->lastvector != NULL && !interrupted) {
+		/** an interrupted batch has zero vectors for the pairs it never reached, and the result
+		 * may be recycled while the copy is still needed **/
+		memcpy(pbag->lastvector, presult->eigenvector, (size_t)pbag->batchcount*pbag->r*pbag->n*sizeof(double));
+		pbag->resultcount = pbag->batchcount;
+	}
+	fillresult(pbag, pnext);
 
+	return presult;
+}
 
+/** job of a checkpoint: its perturbation and iterates as they were, the pairs already converged
+ * take an iteration or two; a start vector that was never reached by the engine (zero in a fresh
+ * result) is drawn as the job drew it the first time
+ * **/
+static void resumejob(powerbag *pbag, powerjob *pjob)
+{
+	int n = pbag->n, r = pbag->r, f;
+	double *start;
+
+	pbag->seed[0] = pjob->seed;
+	memcpy(pbag->scratch, pjob->resume, n*sizeof(double));
+	memcpy(pbag->vector0, &pjob->resume[n], (size_t)r*n*sizeof(double));
+	for (f = 0; f < r; f++) {
+		start = &pbag->vector0[(size_t)f*n];
+		if (LINdot(n, start, start) == 0)
+			RNGuniform(pjob->seed, pjob->jobnumber, RNGSTART, (size_t)f*n, n, start);
+	}
+	pbag->warm = 1;
+}
 
-		/** initialize first vector to random**/
-		for(j = 0; j < n*1; j++){
-			vector0[j] = rand_r(&pbag->rseed)/((double) RAND_MAX);
-		}
+/** run the engine of the bag on the current batch, from vector0 (warm or not), and count the
+ * matvecs of every slot; returns 1 if the batch was interrupted
+ * **/
+int PWRrunengine(powerbag *pbag)
+{
+	int interrupted, slot;
+
+	pbag->stopreason = STOPNONE;
+	pbag->draws = 0;
+	if (pbag->psched != NULL)
+		PWRschedstart(&pbag->progress, pbag->batchcount);
+
+	switch (pbag->engine) {
+	case ENGINESUBSPACE:
+		interrupted = PWRsubspace(pbag);
+		pbag->matvecs[0] = pbag->iterations[0]*pbag->r; /** one block product is r matvecs **/
+		break;
+	case ENGINELANCZOS:
+		interrupted = PWRlanczos(pbag);
+		break;
+	default:
+		if (pbag->batch > 1)
+			interrupted = PWRbatchpower(pbag);
+		else
+			interrupted = PWRpowermethod(pbag);
+		for (slot = 0; slot < pbag->batchcount; slot++)
+			pbag->matvecs[slot] = pbag->iterations[slot];
+		break;
+	}
 
-		/** copy Q into Q'  so that we only deal with Q' and afterwards**/
-		for (j = 0; j < n*n; j++)
-			pbag->qprime[j] = pbag->q[j];
+	return interrupted;
+}
 
-		for (f = 0; f < r; f++) {
-			/** copy f-th column vector0 into vector **/
-			for(j = 0; j < n; j++){
-				vector[f*n + j] = vector0[f*n + j];
-			}
-			for(k = 0; ; k++) {
+/** worker loop: pull a job, perturb, run the selected engine, push the results
+ * the worker sleeps in PWRqueuepop while there is nothing to do and leaves once the job
+ * queue is closed and empty
+ * **/
+void PWRpoweralg(powerbag *pbag)
+{
+	int n, r;
+	int slot, f, interrupted;
+	double *vector0, *start, left, mean;
+	int retcode;
+	powerjob *pjob;
+	powerresult *presult;
 
-				/* PWRshowvector(n, vector);*/
-				PWRpoweriteration(ID, k, n, &vector[f*n], &newvector[f*n], pbag->qprime, &pbag->eigenvalue[f], &error, pbag->poutputmutex);
-				if(error < tolerance){
-					/** finished to compute f-th eigen value **/
+	n = pbag->n;
+	r = pbag->r;
 
+	pthread_mutex_lock(pbag->poutputmutex);
+	printf("ID %d starts\n", pbag->ID);
+	pthread_mutex_unlock(pbag->poutputmutex);
 
-					/** Set Q' = Q' - lambda w w^T **/
-					for(i = 0; i < n; i++){
-						for (j = 0; j < n; j++){
-							pbag->qprime[i*n + j] -= pbag->eigenvalue[f]*vector[f*n + i]*vector[f*n + j];
-						}
-					}
 
-					/** Set w'_0 = w_0 - (w^T w_0) w **/
-					if (f < r-1) {
-						/** first compute sp = (w^T w_0)**/
-						sp = 0.0;
-						for (j = 0; j < n; j++) {
-							sp += vector[f*n + j] * vector0[f*n + j];
-						}
-						/** Set w'_0 = w_0 - sp * w **/
-						for (j = 0; j < n; j++) {
-							vector0[(f+1)*n + j] = vector0[f*n + j] - sp * vector[f*n + j];
-						}
-					}
+	vector0 = pbag->vector0;
+	PRBINIT(pbag->pprobe, pbag->ID);
 
+	/** the helpers are started by the worker itself **/
+	if (pbag->teamsize > 1 && PWRteamcreate(&pbag->pteam, pbag->teamsize, n, pbag->batch > r ? pbag->batch : r, r))
+		goto DONE;
 
-					pthread_mutex_lock(pbag->poutputmutex);
-					printf(" ID %d converged to tolerance %g! on job %d at iteration %d\n", ID, tolerance, pbag->jobnumber, k);
-					printf(" ID %d %d-th eigenvalue:  %g!\n", ID, f, pbag->eigenvalue[f]);
-					pthread_mutex_unlock(pbag->poutputmutex);
+	for(;;){
+		pjob = (powerjob *) PWRqueuepop(pbag->pjobs);
+		if (pjob == NULL || *pbag->pstop)
+			break;
+		PRBPHASE(pbag->pprobe, PHASESETUP);
 
-					break;
-				}
-				pbag->itercount = k;  /** well, in this case we don't really need k **/
-				if(0 == k%1000){
-					pthread_mutex_lock(pbag->psynchro);
+		pbag->jobnumber = pjob->jobnumber;
+		pbag->batchcount = pjob->count;
+		pbag->itercount = 0;
 
-					interrupting = 0;
-					if(pbag->command == INTERRUPT || pbag->command == QUIT){
-						pthread_mutex_lock(pbag->poutputmutex);
-						printf(" ID %d interrupting after %d iterations\n", pbag->ID, k);
-						pthread_mutex_unlock(pbag->poutputmutex);
+		pthread_mutex_lock(pbag->poutputmutex);
+		printf("ID %d: got job %d (%d in batch)\n", pbag->ID, pbag->jobnumber, pbag->batchcount);
+		pthread_mutex_unlock(pbag->poutputmutex);
 
-						interrupting = 1;
-					}
+		/** the worker is free: leave the job to a later run if it cannot finish in time **/
+		if (!PWRschedadmit(pbag->psched, pbag->batchcount, &left, &mean)) {
+			pthread_mutex_lock(pbag->poutputmutex);
+			printf("scheduler: job %d (%d in batch) skipped, %.3f s left before the deadline and jobs take %.3f s\n", pbag->jobnumber, pbag->batchcount, left, mean);
+			pthread_mutex_unlock(pbag->poutputmutex);
+			PRBPHASE(pbag->pprobe, PHASEWAIT);
+			continue;
+		}
 
-					pthread_mutex_unlock(pbag->psynchro);
+		if (pjob->resume != NULL) {
+			/** an interrupted job of a checkpoint goes on from where it stopped **/
+			resumejob(pbag, pjob);
+		}
+		else {
+			for (slot = 0; slot < pbag->batchcount; slot++) {
+				/** let's do the perturbation here **/
+				/** only the vector s is drawn, Q = qcopy + s s^T is applied implicitly **/
+				pbag->seed[slot] = pbag->rseed;
+				if((retcode = cheap_rank1perturb(n, &pbag->scratch[slot*n], pbag->rseed, pbag->jobnumber + slot, pbag->scale)))
+					goto DONE;
+			}
 
-					if (interrupting)
-						break; /** takes you outside of for loop **/
-				}
+			/** warm start: the perturbation is small, the unperturbed or the previous eigen vectors are
+			 * nearly converged for the new job **/
+			pbag->warm = 0;
+			if (pbag->warmstart == WARMBASE) {
+				for (slot = 0; slot < pbag->batchcount; slot++)
+					memcpy(&vector0[(size_t)slot*n*r], pbag->basevector, (size_t)r*n*sizeof(double));
+				pbag->warm = 1;
+			}
+			else if (pbag->warmstart == WARMLAST && pbag->batchcount <= pbag->resultcount) {
+				memcpy(vector0, pbag->lastvector, (size_t)pbag->batchcount*r*n*sizeof(double));
+				/** a pair that did not converge has no vector to start from, it is drawn like a cold start **/
+				for (slot = 0; slot < pbag->batchcount; slot++)
+					for (f = 0; f < r; f++) {
+						start = &vector0[(size_t)slot*n*r + (size_t)f*n];
+						if (LINdot(n, start, start) == 0)
+							RNGuniform(pbag->rseed, pbag->jobnumber + slot, RNGSTART, (size_t)f*n, n, start);
+					}
+				pbag->warm = 1;
+			}
+			else {
+				/** the first vector, or the whole r x n block for the block engine, from the stream of the job **/
+				for (slot = 0; slot < pbag->batchcount; slot++)
+					RNGuniform(pbag->rseed, pbag->jobnumber + slot, RNGSTART, 0, (size_t)n*(pbag->engine == ENGINESUBSPACE ? r : 1), &vector0[(size_t)slot*n*r]);
 			}
-			if (interrupting)
-				break; /** takes you outside of for loop **/
 		}
 
-		/** first, let's check if we have been told to quit **/
-		pthread_mutex_lock(pbag->psynchro);
-		if(pbag->command == QUIT)
-			forcedquit = 1;
-		pthread_mutex_unlock(pbag->psynchro);
+		PRBPHASE(pbag->pprobe, PHASEITERATE);
+		interrupted = PWRrunengine(pbag);
+		if (pbag->psched != NULL)
+			PWRschedjobdone(pbag->psched, &pbag->progress, interrupted ? pbag->stopreason : STOPNONE);
 
-		if(forcedquit)
-			break;
+		PRBPHASE(pbag->pprobe, PHASERESULT);
 
-		pthread_mutex_lock(pbag->psynchro);
-		pbag->status = DONEWITHWORK;
-		pbag->command = STANDBY;
-		pthread_mutex_unlock(pbag->psynchro);
+		presult = handresult(pbag, interrupted);
+		if (presult == NULL)
+			break;
+		PRBJOB(pbag->pprobe, pbag->jobnumber, pbag->batchcount, presult->iterations, presult->matvecs);
+		if (PWRqueuepush(pbag->pdone, presult)) {
+			PWRreleaseresult(presult);
+			break;
+		}
+		PRBPHASE(pbag->pprobe, PHASEWAIT);
 	}
 
 	DONE:
+	PRBCLOSE(pbag->pprobe);
+	PWRteamdestroy(&pbag->pteam);
+	PWRqueuedetach(pbag->pdone); /** the last worker out closes the completion queue **/
+
 	pthread_mutex_lock(pbag->poutputmutex);
 	printf(" ID %d quitting\n", pbag->ID);
 	pthread_mutex_unlock(pbag->poutputmutex);
@@ -1,58 +1,179 @@
 #ifndef POWER
 #define POWER
 
+#include <signal.h>
+#include "operator.h"
+#include "queue.h"
+#include "matio.h"
+#include "probe.h"
+#include "scheduler.h"
+#include "random.h"
+#include "arena.h"
+
 
 #define NOMEMORY 100
 
+/** a job handed to a worker through the job queue: jobs jobnumber .. jobnumber + count - 1 **/
+typedef struct powerjob{
+	int jobnumber;
+	int count;
+	const double *resume; /** interrupted job of a checkpoint (count 1): its perturbation then its r x n iterates, NULL otherwise **/
+	unsigned int seed; /** its seed, with resume **/
+	int priority; /** queue order, higher first (-P) **/
+}powerjob;
 
-#define WAITING 100
-#define WORKING 101
-#define PREANYTHING 102
-#define DONEWITHWORK 103
+/** what a worker pushes on the completion queue once a batch is done.
+ * The worker computes in place: its eigen values and vectors, perturbations and counters point into
+ * the result it is filling, which is handed off as is (no copy) while the worker goes on with a
+ * recycled one. Whoever is done with it last (the master or the result sink) gives it back with
+ * PWRreleaseresult. Arrays have room for a full batch, count entries are used.
+ * **/
+typedef struct powerresult{
+	int ID; /** worker that ran the job **/
+	int jobnumber;
+	int count; /** jobs in the batch **/
+	int r;
+	int n;
+	int interrupted;
+	unsigned int *seed; /** count entries, seed the job drew its numbers with (random.h) **/
+	int *iterations; /** count entries **/
+	int *matvecs; /** count entries, products with the matrix, to compare engines **/
+	int *refined; /** count entries, those of the matvecs done on the double matrix in a low precision run **/
+	double *eigenvalue; /** count x r entries **/
+	double *eigenvector; /** count blocks of r x n **/
+	double *perturbation; /** count x n, the vector s of every job **/
+	struct powerbag *owner; /** bag it is recycled in **/
+	struct powerresult *next; /** free list of the owner **/
+}powerresult;
 
+/** eigen solver engines **/
+#define ENGINEPOWER 0
+#define ENGINESUBSPACE 1
+#define ENGINELANCZOS 2
 
-#define QUIT 200
-#define WORK 201
-#define STANDBY 202
-#define INTERRUPT 203
+/** low precision iterations without progress after which a pair goes on with the double matrix **/
+#define PRECSTALL 20
+
+/** starting vectors of the jobs **/
+#define WARMRANDOM 0 /** fresh random vectors **/
+#define WARMBASE 1 /** eigen vectors of the unperturbed matrix, see PWRsolvebase **/
+#define WARMLAST 2 /** vectors of the last job the worker completed **/
+
+/** run parameters shared by all the workers, filled from the command line **/
+typedef struct powerconfig{
+	int r; /** number of eigen values and vectors we want **/
+	double scale; /** scale parameter for the rank 1 perturb **/
+	double tolerance;
+	int engine; /** ENGINEPOWER, ENGINESUBSPACE or ENGINELANCZOS **/
+	int krylov; /** Lanczos basis size, 0 to pick it from r **/
+	int sharedmatrix; /** 1 if all bags read the matrix loaded by PWRreadnload instead of a private copy **/
+	int batch; /** number of jobs a worker advances together (power engine) **/
+	int maxiterations; /** a job still running after that many iterations is interrupted **/
+	unsigned int seed; /** of the random numbers of every job, see random.h **/
+	pwrscheduler *psched; /** time limits of the jobs, NULL for none, see scheduler.h **/
+	int teamsize; /** threads sharing every job, 1 for one thread per job **/
+	int warmstart; /** WARMRANDOM, WARMBASE or WARMLAST **/
+	const double *basevector; /** r x n eigen vectors of the unperturbed matrix, shared read only (WARMBASE) **/
+	int precision; /** storage precision of the matrix during the iterations, see kernels.h **/
+	const void *lowmatrix; /** the packed matrix in that precision, shared read only, NULL for PRECDOUBLE **/
+	const pwrfactor *factor; /** Q0 as a factor model, shared read only, NULL for the packed matrix **/
+	char *streamfile; /** packed binary file Q0 is streamed from at every product (-O), NULL to hold it in memory **/
+	size_t streambytes; /** memory every worker streams it through **/
+}powerconfig;
 
 typedef struct powerbag{
 	int n;
 	int r; /** number of eigen values and vectors we want to save in the pca (r == 2 for the homework)**/
-	double *q; /** perturbed cov matrix (initially it was called q) used at the begining of a power method iteration**/
-	double *qprime; /** Q' cov matrix used in the power method **/
-	double *qcopy; /** initial covariance Q (initially it was called matcopy) **/
-	double *scratch; /** vector used for the rank 1 perturbation **/
+	double *qcopy; /** initial covariance Q (initially it was called matcopy), packed upper triangle, read only **/
+	int ownsqcopy; /** 0 if qcopy is the matrix shared by all bags **/
+	double *scratch; /** vector used for the rank 1 perturbation, Q = qcopy + scratch scratch^T **/
 	double *eigenvalue; /** Array of eigen values sorted in decreasing order**/
 	double *vector; /** Corresponding matrix of eigen vectors (r x n matrix) **/
+	unsigned int *seed; /** seed each job of the batch draws its numbers with, see random.h **/
+	powerresult *presult; /** result being filled: scratch, eigenvalue, vector, seed and the counters point into it **/
+	powerresult *freeresults; /** results given back by the master or the sink, ready for reuse **/
+	pthread_mutex_t freemutex;
+	double *lastvector; /** copy of the vectors of the last batch that was not interrupted, for WARMLAST (in the arena) **/
 	double *vector0; /** Corresponding matrix of eigen vectors at iteration 0 (r x n matrix) **/
 	double *newvector; /** Matrix of new eigen vectors at the end of an iteration (r x n matrix)**/
+	double *smallwork; /** two r x r matrices used by the block engines **/
 	double scale; /** scale parameter for the rank 1 perturb **/
 	double tolerance;
+	int engine; /** which eigen solver runs the jobs **/
+
+	/** batched execution: job slot s of the current batch is job jobnumber + s, its perturbation is
+	 * scratch[s*n], its eigen values eigenvalue[s*r] and its vectors the r x n blocks at offset s*r*n **/
+	int batch; /** number of job slots **/
+	int batchcount; /** jobs in the current batch, at most batch **/
+	double *blockx; /** batch x n block of current iterates, one row per active job **/
+	double *blocky; /** batch x n block receiving Q times blockx **/
+	int *batchslot; /** job slot of every row of blockx **/
+	int *batchlevel; /** eigen pair each job slot is working on **/
+	pwroperator *batchop; /** implicit operator of every job slot **/
+	int *iterations; /** total iterations of every job slot, summed over its r eigen pairs **/
+	int *matvecs; /** matrix vector products of every job slot **/
+	int krylov; /** Lanczos basis size m **/
+	double *krylovwork; /** Lanczos basis and projected matrices, see lanczos.c **/
+
+	int warmstart; /** WARMRANDOM, WARMBASE or WARMLAST **/
+	const double *basevector; /** shared unperturbed eigen vectors for WARMBASE **/
+	int warm; /** 1 if vector0 holds all the r starting vectors of every slot of the current batch **/
+	int resultcount; /** job slots in lastvector, for WARMLAST **/
+
+	/** mixed precision: the pairs are iterated on lowmatrix, then refined on qcopy **/
+	int precision; /** PRECDOUBLE, PRECFLOAT or PRECBF16 **/
+	const void *lowmatrix; /** shared matrix in that precision, NULL for PRECDOUBLE **/
+	double *lowbest; /** best error of every job slot in the low precision phase **/
+	int *lowstall; /** iterations of every job slot since that best error **/
+	int *refined; /** matvecs of every job slot done on the double matrix **/
+
+	const pwrfactor *factor; /** Q0 as a factor model (qcopy is NULL), NULL otherwise **/
+	double *factorwork; /** 2 k max(batch, r) doubles for its products **/
+	pwrstream *stream; /** its own stream of Q0 (qcopy is NULL), NULL otherwise **/
+
+	pwrarena arena; /** holds every buffer above but the results and the matrices **/
 
 	int ID; /** worker thread ID **/
-	int status; /** status code **/
-	int command; /** command code **/
 	int jobnumber;
 	int itercount;
-	pthread_mutex_t *psynchro; /** mutex pointer for communication with the master thread **/
+	int maxiterations;
+	pwrscheduler *psched; /** shared time limits, NULL for none **/
+	pwrprogress progress; /** of the current batch, for psched **/
+	int stopreason; /** why the last batch was interrupted, STOPNONE if it was not **/
+	int teamsize; /** threads working on each job of this worker, itself included **/
+	struct pwrteam *pteam; /** its helper threads, NULL if teamsize is 1 **/
+#ifdef PWRPROBE
+	pwrprobe *pprobe; /** phase timers of the worker, written by its thread only **/
+#endif
+	pwrqueue *pjobs; /** queue the worker pulls its jobs from **/
+	pwrqueue *pdone; /** queue the worker pushes its results to **/
+	volatile sig_atomic_t *pstop; /** set by the master on SIGINT, every job stops **/
 	pthread_mutex_t *poutputmutex; /** mutex pointer for outputing text to the console**/
-	unsigned int rseed; /** thread's random seed
-	I used rand_r() inside threads because rand() is not thread safe and every time it is called, it updates
-	an internal value so there is a non zero (though very low) risk of multiple core accessing the seed at the same
-	time. That is why I prefer to give a specific seed to every thread. Moreover it allows result reproducibility.
-	**/
+	unsigned int rseed; /** seed of the run (-g): the random numbers of a job are keyed by it, the job
+	number and a stream (random.h), not by the worker, so that a job gives the same result whoever runs it **/
+	unsigned int draws; /** RNGRESTART vectors drawn by the current job **/
 }powerbag;
 
 
 void PWRshowvector(int n, double *vector);
 void PWRfree(void **paddress);
-int PWRreadnload(char *filename, int *pn, double **pmatrix);
-int PWRallocatebag(int ID, int n, int r, double *covmatrix, powerbag **ppbag, double scale, double tolerance, pthread_mutex_t *psyncmutex, pthread_mutex_t *poutputmutex);
+long PWRresidentbytes(void);
+int PWRallocatebag(int ID, int n, double *covmatrix, powerconfig *pconfig, powerbag **ppbag, pwrqueue *pjobs, pwrqueue *pdone, volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex);
 void PWRfreebag(powerbag **ppbag);
+void PWRreleaseresult(powerresult *presult);
+int PWRsolvebase(int n, double *covmatrix, powerconfig *pconfig, volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex, double **pbasevector);
 void PWRpoweralg(powerbag *pbag);
+int PWRrunengine(powerbag *pbag);
+int PWRcheckinterrupt(powerbag *pbag, int k, double error);
+int PWRlowphasedone(double error, double tolerance, double *pbest, int *pstall);
+int PWRrefine(powerbag *pbag, pwroperator *op, double *x, double *y, double *peigenvalue, double *perror);
+int PWRpowermethod(powerbag *pbag);
+int PWRsubspace(powerbag *pbag);
+int PWRlanczos(powerbag *pbag);
+int PWRbatchpower(powerbag *pbag);
+void PWRnextstart(int n, int f, double *vector, double *vector0);
 void PWRpoweriteration(int ID, int k, 
-		int n, double *vector, double *newvector, double *q,
+		int n, double *vector, double *newvector, pwroperator *op,
 		double *peigenvalue, double *perror,
 		pthread_mutex_t *poutputmutex);
 void PWRcompute_error(int n, double *perror, double *newvector, double *vector);
@@ -0,0 +1,191 @@
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "utilities.h"
+#include "probe.h"
+
+/** Per worker phase timers and counters, see probe.h.
+ * The hardware counters are opened by the worker thread itself (pid 0, any cpu) and count only
+ * that thread in user mode; the helper threads of a team are not included. When the kernel
+ * refuses perf_event_open (perf_event_paranoid, containers) only the times are reported.
+ * **/
+
+static const char *phasename[PHASECOUNT] = {"wait", "setup", "iterate", "refine", "result"};
+
+static int opencounter(uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.size = sizeof(attr);
+	attr.config = config;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void readcounters(pwrprobe *pprobe, uint64_t *value)
+{
+	int c;
+
+	for (c = 0; c < COUNTERCOUNT; c++)
+		if (pprobe->fd[c] < 0 || read(pprobe->fd[c], &value[c], sizeof(uint64_t)) != sizeof(uint64_t))
+			value[c] = 0;
+}
+
+/** times only, no counter open: what a bag's probe is until its worker calls PRBinit, so that
+ * the engines run outside PWRpoweralg (rolling, daemon, base solve) can switch phases safely
+ * **/
+void PRBreset(pwrprobe *pprobe, int ID)
+{
+	int c;
+
+	memset(pprobe, 0, sizeof(pwrprobe));
+	pprobe->ID = ID;
+	for (c = 0; c < COUNTERCOUNT; c++)
+		pprobe->fd[c] = -1;
+	pprobe->phase = PHASEWAIT;
+	pprobe->origin = pprobe->phasestart = PWRseconds();
+}
+
+/** to be called by the thread being measured, starts in PHASEWAIT **/
+void PRBinit(pwrprobe *pprobe, int ID)
+{
+	memset(pprobe, 0, sizeof(pwrprobe));
+	pprobe->ID = ID;
+	pprobe->fd[COUNTERCYCLES] = opencounter(PERF_COUNT_HW_CPU_CYCLES);
+	pprobe->fd[COUNTERLLCMISSES] = opencounter(PERF_COUNT_HW_CACHE_MISSES);
+	pprobe->phase = PHASEWAIT;
+	pprobe->origin = pprobe->phasestart = PWRseconds();
+	readcounters(pprobe, pprobe->counterstart);
+}
+
+/** ends the phase being timed, the probe can still be read **/
+void PRBclose(pwrprobe *pprobe)
+{
+	int c;
+
+	PRBswitch(pprobe, pprobe->phase);
+	for (c = 0; c < COUNTERCOUNT; c++)
+		if (pprobe->fd[c] >= 0) {
+			close(pprobe->fd[c]);
+			pprobe->fd[c] = -1;
+		}
+}
+
+/** charge the time since the last switch to the current phase and enter phase **/
+void PRBswitch(pwrprobe *pprobe, int phase)
+{
+	int c;
+	double t = PWRseconds();
+	uint64_t value[COUNTERCOUNT];
+
+	readcounters(pprobe, value);
+	pprobe->seconds[pprobe->phase] += t - pprobe->phasestart;
+	++pprobe->entries[pprobe->phase];
+	for (c = 0; c < COUNTERCOUNT; c++) {
+		pprobe->counters[pprobe->phase][c] += value[c] - pprobe->counterstart[c];
+		pprobe->counterstart[c] = value[c];
+	}
+	pprobe->phasestart = t;
+	pprobe->phase = phase;
+	if (phase == PHASESETUP)
+		pprobe->jobstart = t;
+}
+
+/** record a finished batch of count jobs, timed from its PHASESETUP **/
+void PRBjob(pwrprobe *pprobe, int jobnumber, int count, int *iterations, int *matvecs)
+{
+	int b;
+	pwrprobejob *pjob = &pprobe->job[pprobe->jobs % PROBEJOBS];
+
+	pjob->jobnumber = jobnumber;
+	pjob->count = count;
+	pjob->iterations = pjob->matvecs = 0;
+	for (b = 0; b < count; b++) {
+		pjob->iterations += iterations[b];
+		pjob->matvecs += matvecs[b];
+	}
+	pjob->start = pprobe->jobstart - pprobe->origin;
+	pjob->end = PWRseconds() - pprobe->origin;
+	++pprobe->jobs;
+}
+
+/** totals over the workers, per phase **/
+void PRBreport(pwrprobe **probes, int count)
+{
+	int j, p, hardware = 0;
+	long jobs = 0;
+	double seconds[PHASECOUNT], total = 0, jobseconds = 0;
+	uint64_t counters[PHASECOUNT][COUNTERCOUNT];
+	pwrprobejob *pjob;
+
+	memset(seconds, 0, sizeof(seconds));
+	memset(counters, 0, sizeof(counters));
+	for (j = 0; j < count; j++) {
+		hardware |= probes[j]->counters[PHASEITERATE][COUNTERCYCLES] > 0;
+		for (p = 0; p < PHASECOUNT; p++) {
+			seconds[p] += probes[j]->seconds[p];
+			total += probes[j]->seconds[p];
+			counters[p][COUNTERCYCLES] += probes[j]->counters[p][COUNTERCYCLES];
+			counters[p][COUNTERLLCMISSES] += probes[j]->counters[p][COUNTERLLCMISSES];
+		}
+		for (p = 0; p < PROBEJOBS && p < probes[j]->jobs; p++) {
+			pjob = &probes[j]->job[p];
+			jobseconds += pjob->end - pjob->start;
+			jobs += pjob->count;
+		}
+	}
+
+	printf("probe: %d workers, %ld jobs recorded, %.6f s per job on average\n", count, jobs, jobs ? jobseconds/jobs : 0);
+	for (p = 0; p < PHASECOUNT; p++) {
+		printf("probe: %-8s %12.6f s %6.2f%%", phasename[p], seconds[p], total > 0 ? 100*seconds[p]/total : 0);
+		if (hardware)
+			printf("  %14llu cycles  %12llu LLC misses  %10.1f MB", (unsigned long long)counters[p][COUNTERCYCLES],
+					(unsigned long long)counters[p][COUNTERLLCMISSES], counters[p][COUNTERLLCMISSES]*(double)PROBELINE/1048576.0);
+		printf("\n");
+	}
+	if (!hardware)
+		printf("probe: no hardware counters (perf_event_open not permitted)\n");
+}
+
+/** everything, per worker, with the job records **/
+int PRBwritejson(char *filename, pwrprobe **probes, int count)
+{
+	FILE *out;
+	int j, p, first;
+	long k;
+	pwrprobejob *pjob;
+
+	if ((out = fopen(filename, "w")) == NULL) {
+		printf("cannot open %s\n", filename);
+		return 1;
+	}
+
+	fprintf(out, "{\"workers\": [");
+	for (j = 0; j < count; j++) {
+		fprintf(out, "%s\n {\"id\": %d, \"counters\": %s, \"phases\": {", j ? "," : "", probes[j]->ID,
+				probes[j]->counters[PHASEITERATE][COUNTERCYCLES] > 0 ? "true" : "false");
+		for (p = 0; p < PHASECOUNT; p++)
+			fprintf(out, "%s\"%s\": {\"seconds\": %.9f, \"entries\": %ld, \"cycles\": %llu, \"llcmisses\": %llu, \"bytes\": %llu}",
+					p ? ", " : "", phasename[p], probes[j]->seconds[p], probes[j]->entries[p],
+					(unsigned long long)probes[j]->counters[p][COUNTERCYCLES], (unsigned long long)probes[j]->counters[p][COUNTERLLCMISSES],
+					(unsigned long long)probes[j]->counters[p][COUNTERLLCMISSES]*PROBELINE);
+		fprintf(out, "},\n  \"jobs\": [");
+		/** oldest record first **/
+		first = 1;
+		for (k = probes[j]->jobs > PROBEJOBS ? probes[j]->jobs - PROBEJOBS : 0; k < probes[j]->jobs; k++) {
+			pjob = &probes[j]->job[k % PROBEJOBS];
+			fprintf(out, "%s{\"job\": %d, \"count\": %d, \"iterations\": %d, \"matvecs\": %d, \"start\": %.9f, \"end\": %.9f}",
+					first ? "" : ", ", pjob->jobnumber, pjob->count, pjob->iterations, pjob->matvecs, pjob->start, pjob->end);
+			first = 0;
+		}
+		fprintf(out, "]}");
+	}
+	fprintf(out, "\n]}\n");
+	fclose(out);
+
+	return 0;
+}
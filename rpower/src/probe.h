@@ -0,0 +1,73 @@
+#ifndef PROBE
+#define PROBE
+
+#include <stdio.h>
+#include <stdint.h>
+
+/** Hot path instrumentation of the workers, compiled in with -DPWRPROBE (make PROBE=1).
+ * Every worker owns a pwrprobe that only its own thread writes, so nothing is locked: the
+ * worker switches phase with PRBPHASE, which adds the monotonic time (and the hardware counters,
+ * when perf_event_open is allowed) spent in the phase it leaves, and records every job it
+ * finishes with PRBJOB. The master reads the probes once the workers are joined.
+ * Without PWRPROBE the macros are empty and the bags have no probe: nothing is left in the hot path.
+ * **/
+
+#define PHASEWAIT 0 /** sleeping on the job queue **/
+#define PHASESETUP 1 /** perturbation and starting vectors **/
+#define PHASEITERATE 2 /** the engine: matvecs, deflation and Ritz steps **/
+#define PHASEREFINE 3 /** double precision refinement of low precision pairs (PWRrefine) **/
+#define PHASERESULT 4 /** packaging and pushing the results **/
+#define PHASECOUNT 5
+
+#define COUNTERCYCLES 0
+#define COUNTERLLCMISSES 1 /** times the cache line size, an estimate of the bytes read from memory **/
+#define COUNTERCOUNT 2
+#define PROBELINE 64
+
+#define PROBEJOBS 1024 /** job records kept by a worker, the oldest ones are overwritten **/
+
+typedef struct pwrprobejob{
+	int jobnumber;
+	int count; /** jobs in the batch **/
+	int iterations; /** summed over the batch, as the matvecs **/
+	int matvecs;
+	double start; /** seconds since the probe started, setup to result pushed **/
+	double end;
+}pwrprobejob;
+
+typedef struct pwrprobe{
+	int ID;
+	int fd[COUNTERCOUNT]; /** perf_event descriptors of the worker thread, -1 if unavailable **/
+	int phase; /** phase being timed **/
+	double origin; /** PRBinit time **/
+	double phasestart;
+	double jobstart; /** start of the last PHASESETUP **/
+	uint64_t counterstart[COUNTERCOUNT];
+	double seconds[PHASECOUNT];
+	long entries[PHASECOUNT];
+	uint64_t counters[PHASECOUNT][COUNTERCOUNT];
+	long jobs; /** records written, the last PROBEJOBS are in job **/
+	pwrprobejob job[PROBEJOBS];
+}pwrprobe;
+
+#ifdef PWRPROBE
+#define PRBINIT(pprobe, ID) PRBinit(pprobe, ID)
+#define PRBCLOSE(pprobe) PRBclose(pprobe)
+#define PRBPHASE(pprobe, phase) PRBswitch(pprobe, phase)
+#define PRBJOB(pprobe, jobnumber, count, iterations, matvecs) PRBjob(pprobe, jobnumber, count, iterations, matvecs)
+#else
+#define PRBINIT(pprobe, ID)
+#define PRBCLOSE(pprobe)
+#define PRBPHASE(pprobe, phase)
+#define PRBJOB(pprobe, jobnumber, count, iterations, matvecs)
+#endif
+
+void PRBreset(pwrprobe *pprobe, int ID);
+void PRBinit(pwrprobe *pprobe, int ID);
+void PRBclose(pwrprobe *pprobe);
+void PRBswitch(pwrprobe *pprobe, int phase);
+void PRBjob(pwrprobe *pprobe, int jobnumber, int count, int *iterations, int *matvecs);
+void PRBreport(pwrprobe **probes, int count);
+int PRBwritejson(char *filename, pwrprobe **probes, int count);
+
+#endif
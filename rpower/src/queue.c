@@ -0,0 +1,112 @@
+#include "utilities.h"
+#include "power.h"
+#include "queue.h"
+
+int PWRqueueinit(pwrqueue *pqueue, int capacity, int producers)
+{
+	int retcode = 0;
+
+	memset(pqueue, 0, sizeof(pwrqueue));
+	pqueue->items = (void **)calloc(capacity, sizeof(void *));
+	if (pqueue->items == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	pqueue->capacity = capacity;
+	pqueue->producers = producers;
+	pthread_mutex_init(&pqueue->mutex, NULL);
+	pthread_cond_init(&pqueue->notempty, NULL);
+	pthread_cond_init(&pqueue->notfull, NULL);
+
+	BACK:
+	return retcode;
+}
+
+void PWRqueuedestroy(pwrqueue *pqueue)
+{
+	if (pqueue->items == NULL) return;
+
+	free(pqueue->items);
+	pqueue->items = NULL;
+	pthread_mutex_destroy(&pqueue->mutex);
+	pthread_cond_destroy(&pqueue->notempty);
+	pthread_cond_destroy(&pqueue->notfull);
+}
+
+/** blocks while the queue is full, returns 1 if the queue was closed **/
+int PWRqueuepush(pwrqueue *pqueue, void *item)
+{
+	int retcode = 0;
+
+	pthread_mutex_lock(&pqueue->mutex);
+	while (pqueue->count == pqueue->capacity && !pqueue->closed)
+		pthread_cond_wait(&pqueue->notfull, &pqueue->mutex);
+	if (pqueue->closed) {
+		retcode = 1;
+	}
+	else {
+		pqueue->items[(pqueue->head + pqueue->count) % pqueue->capacity] = item;
+		++pqueue->count;
+		pthread_cond_signal(&pqueue->notempty);
+	}
+	pthread_mutex_unlock(&pqueue->mutex);
+
+	return retcode;
+}
+
+/** blocks while the queue is empty, returns NULL once it is closed and drained **/
+void *PWRqueuepop(pwrqueue *pqueue)
+{
+	void *item = NULL;
+
+	pthread_mutex_lock(&pqueue->mutex);
+	while (pqueue->count == 0 && !pqueue->closed)
+		pthread_cond_wait(&pqueue->notempty, &pqueue->mutex);
+	if (pqueue->count > 0) {
+		item = pqueue->items[pqueue->head];
+		pqueue->head = (pqueue->head + 1) % pqueue->capacity;
+		--pqueue->count;
+		pthread_cond_signal(&pqueue->notfull);
+	}
+	pthread_mutex_unlock(&pqueue->mutex);
+
+	return item;
+}
+
+/** wake everybody up: pending items can still be popped, then pop returns NULL **/
+void PWRqueueclose(pwrqueue *pqueue)
+{
+	pthread_mutex_lock(&pqueue->mutex);
+	pqueue->closed = 1;
+	pthread_cond_broadcast(&pqueue->notempty);
+	pthread_cond_broadcast(&pqueue->notfull);
+	pthread_mutex_unlock(&pqueue->mutex);
+}
+
+/** a producer is done pushing, the last one closes the queue **/
+void PWRqueuedetach(pwrqueue *pqueue)
+{
+	int last;
+
+	pthread_mutex_lock(&pqueue->mutex);
+	last = (--pqueue->producers <= 0);
+	pthread_mutex_unlock(&pqueue->mutex);
+
+	if (last)
+		PWRqueueclose(pqueue);
+}
+
+/** closes the queue and throws away what is still pending, returns the number of items dropped **/
+int PWRqueuedrain(pwrqueue *pqueue)
+{
+	int dropped;
+
+	pthread_mutex_lock(&pqueue->mutex);
+	dropped = pqueue->count;
+	pqueue->count = 0;
+	pqueue->closed = 1;
+	pthread_cond_broadcast(&pqueue->notempty);
+	pthread_cond_broadcast(&pqueue->notfull);
+	pthread_mutex_unlock(&pqueue->mutex);
+
+	return dropped;
+}
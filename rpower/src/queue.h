@@ -0,0 +1,29 @@
+#ifndef QUEUE
+#define QUEUE
+
+#include <pthread.h>
+
+/** bounded blocking FIFO of pointers, used for the job queue (master -> workers) and the
+ * completion queue (workers -> master); pop sleeps on a condition variable, no polling
+ * **/
+typedef struct pwrqueue{
+	void **items;
+	int capacity;
+	int head; /** next item to pop **/
+	int count;
+	int closed; /** no more pushes, pop returns NULL once empty **/
+	int producers; /** closes itself when the last producer detaches **/
+	pthread_mutex_t mutex;
+	pthread_cond_t notempty;
+	pthread_cond_t notfull;
+}pwrqueue;
+
+int PWRqueueinit(pwrqueue *pqueue, int capacity, int producers);
+void PWRqueuedestroy(pwrqueue *pqueue);
+int PWRqueuepush(pwrqueue *pqueue, void *item);
+void *PWRqueuepop(pwrqueue *pqueue);
+void PWRqueueclose(pwrqueue *pqueue);
+void PWRqueuedetach(pwrqueue *pqueue);
+int PWRqueuedrain(pwrqueue *pqueue);
+
+#endif
@@ -0,0 +1,113 @@
+#include <immintrin.h>
+#include <stdint.h>
+#include "utilities.h"
+#include "kernels.h"
+#include "random.h"
+
+/** Philox4x32-10: the counter is (block low, block high, stream, 0), the key (seed, job) **/
+
+#define PHILOXM0 0xD2511F53u
+#define PHILOXM1 0xCD9E8D57u
+#define PHILOXW0 0x9E3779B9u
+#define PHILOXW1 0xBB67AE85u
+#define PHILOXROUNDS 10
+
+#define RNGONE 0x3FF0000000000000ull /** exponent of 1.0 **/
+
+/** 52 bits of (a, b) as a double in [1, 2), minus one **/
+static double todouble(uint32_t a, uint32_t b)
+{
+	uint64_t bits = RNGONE | ((uint64_t)a << 20) | (b >> 12);
+	double d;
+
+	memcpy(&d, &bits, sizeof(double));
+	return d - 1.0;
+}
+
+static void philox(uint64_t block, uint32_t stream, uint32_t seed, uint32_t job, double *pair)
+{
+	uint32_t x0 = (uint32_t)block, x1 = (uint32_t)(block >> 32), x2 = stream, x3 = 0;
+	uint32_t k0 = seed, k1 = job;
+	uint64_t p0, p1;
+	int round;
+
+	for (round = 0; round < PHILOXROUNDS; round++) {
+		p0 = (uint64_t)PHILOXM0*x0;
+		p1 = (uint64_t)PHILOXM1*x2;
+		x0 = (uint32_t)(p1 >> 32) ^ x1 ^ k0;
+		x1 = (uint32_t)p1;
+		x2 = (uint32_t)(p0 >> 32) ^ x3 ^ k1;
+		x3 = (uint32_t)p0;
+		k0 += PHILOXW0;
+		k1 += PHILOXW1;
+	}
+	pair[0] = todouble(x0, x1);
+	pair[1] = todouble(x2, x3);
+}
+
+/** blocks block .. block + 4*quads - 1 into out, every word of a block in a 64 bit lane **/
+__attribute__((target("avx2")))
+static void philox_avx2(uint64_t block, size_t quads, uint32_t stream, uint32_t seed, uint32_t job, double *out)
+{
+	size_t q;
+	int round;
+	uint32_t k0, k1;
+	__m256i x0, x1, x2, x3, p0, p1, counter, low = _mm256_set1_epi64x(0xFFFFFFFFll);
+	__m256i m0 = _mm256_set1_epi64x(PHILOXM0), m1 = _mm256_set1_epi64x(PHILOXM1), one = _mm256_set1_epi64x((long long)RNGONE);
+	__m256d even, odd, lo, hi, vone = _mm256_set1_pd(1.0);
+
+	counter = _mm256_set_epi64x((long long)block + 3, (long long)block + 2, (long long)block + 1, (long long)block);
+	for (q = 0; q < quads; q++) {
+		x0 = _mm256_and_si256(counter, low);
+		x1 = _mm256_srli_epi64(counter, 32);
+		x2 = _mm256_set1_epi64x(stream);
+		x3 = _mm256_setzero_si256();
+		k0 = seed;
+		k1 = job;
+		for (round = 0; round < PHILOXROUNDS; round++) {
+			p0 = _mm256_mul_epu32(x0, m0);
+			p1 = _mm256_mul_epu32(x2, m1);
+			x0 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p1, 32), x1), _mm256_set1_epi64x(k0));
+			x1 = _mm256_and_si256(p1, low);
+			x2 = _mm256_xor_si256(_mm256_xor_si256(_mm256_srli_epi64(p0, 32), x3), _mm256_set1_epi64x(k1));
+			x3 = _mm256_and_si256(p0, low);
+			k0 += PHILOXW0;
+			k1 += PHILOXW1;
+		}
+		even = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(one, _mm256_or_si256(_mm256_slli_epi64(x0, 20), _mm256_srli_epi64(x1, 12)))), vone);
+		odd = _mm256_sub_pd(_mm256_castsi256_pd(_mm256_or_si256(one, _mm256_or_si256(_mm256_slli_epi64(x2, 20), _mm256_srli_epi64(x3, 12)))), vone);
+		/** back in block order: e0 o0 e1 o1 | e2 o2 e3 o3 **/
+		lo = _mm256_unpacklo_pd(even, odd);
+		hi = _mm256_unpackhi_pd(even, odd);
+		_mm256_storeu_pd(&out[8*q], _mm256_permute2f128_pd(lo, hi, 0x20));
+		_mm256_storeu_pd(&out[8*q + 4], _mm256_permute2f128_pd(lo, hi, 0x31));
+		counter = _mm256_add_epi64(counter, _mm256_set1_epi64x(4));
+	}
+}
+
+/** out[0 .. count - 1] receives the numbers first .. first + count - 1 of the stream of the job,
+ * uniform in [0, 1)
+ * **/
+void RNGuniform(unsigned int seed, unsigned int job, unsigned int stream, size_t first, size_t count, double *out)
+{
+	size_t i = 0, quads;
+	double pair[2];
+
+	if (count == 0)
+		return;
+	if (first & 1) {
+		/** second half of a block **/
+		philox(first/2, stream, seed, job, pair);
+		out[i++] = pair[1];
+	}
+	if (KRNisa() != ISASCALAR && (quads = (count - i)/8) > 0) {
+		philox_avx2((first + i)/2, quads, stream, seed, job, &out[i]);
+		i += 8*quads;
+	}
+	for (; i + 2 <= count; i += 2)
+		philox((first + i)/2, stream, seed, job, &out[i]);
+	if (i < count) {
+		philox((first + i)/2, stream, seed, job, pair);
+		out[i] = pair[0];
+	}
+}
@@ -0,0 +1,21 @@
+#ifndef RANDOM
+#define RANDOM
+
+#include <stddef.h>
+
+/** Counter based random numbers (Philox4x32-10, Salmon et al., SC'11): the i-th number of a
+ * stream is a pure function of (seed, job, stream, i), so a job draws the same perturbation and
+ * starting vectors whichever worker runs it and in whatever order, and any slice of a stream can
+ * be filled on its own. One Philox block gives two doubles in [0, 1) with 52 random bits each;
+ * the AVX2 variant computes four blocks at a time and gives the same bits as the scalar one.
+ * **/
+
+/** streams of a job **/
+#define RNGPERTURBATION 0 /** the vector s of the rank 1 perturbation **/
+#define RNGSTART 1 /** the r x n starting vectors **/
+#define RNGRESTART 2 /** directions drawn by the engine during the job (Lanczos breakdowns) **/
+#define RNGBASE 3 /** starting vector of the unperturbed problem and of the rolling mode **/
+
+void RNGuniform(unsigned int seed, unsigned int job, unsigned int stream, size_t first, size_t count, double *out);
+
+#endif
@@ -0,0 +1,235 @@
+#include <pthread.h>
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "matio.h"
+#include "covariance.h"
+#include "team.h"
+#include "rolling.h"
+
+/** covariance and mean of the current window, from scratch: PWRcovariance demeans a copy of the rows **/
+static int rebuild(pwrwindow *pwin)
+{
+	int retcode = 0, t, j, n = pwin->n;
+	size_t count = (size_t)pwin->window*n;
+	double *rows = NULL, *fresh = NULL;
+	const double *x;
+
+	rows = (double *)malloc(count*sizeof(double));
+	if (rows == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	memcpy(rows, &pwin->returns[(size_t)pwin->day*n], count*sizeof(double));
+	if ((retcode = PWRcovariance(pwin->window, n, rows, 0, &fresh)))
+		goto BACK;
+
+	for (j = 0; j < n; j++)
+		pwin->mean[j] = 0;
+	for (t = 0; t < pwin->window; t++) {
+		x = &pwin->returns[(size_t)(pwin->day + t)*n];
+		for (j = 0; j < n; j++)
+			pwin->mean[j] += x[j];
+	}
+	for (j = 0; j < n; j++)
+		pwin->mean[j] /= pwin->window;
+
+	if (pwin->covmatrix == NULL) {
+		pwin->covmatrix = fresh;
+		fresh = NULL;
+	}
+	else {
+		PWRunsealmatrix(pwin->covmatrix, KRNpackedsize(n));
+		memcpy(pwin->covmatrix, fresh, KRNpackedsize(n)*sizeof(double));
+		PWRsealmatrix(pwin->covmatrix, KRNpackedsize(n));
+	}
+	pwin->updates = 0;
+
+	BACK:
+	PWRfreematrix(&fresh, KRNpackedsize(n));
+	free(rows);
+	return retcode;
+}
+
+/** Q += a u u^T + b v v^T + c w w^T on the packed upper triangle, the three rank 1 updates of a
+ * shift in a single pass over the matrix (it is memory bound like the matvec)
+ * **/
+static void rank3update(int n, double *packed, double a, const double *u, double b, const double *v, double c, const double *w)
+{
+	int i, j;
+	double *row = packed, aui, bvi, cwi;
+
+	for (i = 0; i < n; i++) {
+		aui = a*u[i];
+		bvi = b*v[i];
+		cwi = c*w[i];
+		for (j = i; j < n; j++)
+			row[j - i] += aui*u[j] + bvi*v[j] + cwi*w[j];
+		row += n - i;
+	}
+}
+
+int PWRwindowinit(pwrwindow *pwin, const double *returns, int T, int n, int window, int precision)
+{
+	int retcode = 0;
+
+	memset(pwin, 0, sizeof(pwrwindow));
+	if (window < 2 || window > T) {
+		printf("the window must hold 2 to %d rows, not %d\n", T, window);
+		retcode = 1; goto BACK;
+	}
+	pwin->T = T;
+	pwin->n = n;
+	pwin->window = window;
+	pwin->returns = returns;
+	pwin->precision = precision;
+	pwin->mean = (double *)calloc(4*(size_t)n, sizeof(double));
+	if (pwin->mean == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	pwin->work = &pwin->mean[n];
+
+	if ((retcode = rebuild(pwin)))
+		goto BACK;
+	if (precision != PRECDOUBLE && (pwin->lowmatrix = PWRlowermatrix(n, pwin->covmatrix, precision)) == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+
+	BACK:
+	if (retcode)
+		PWRwindowfree(pwin);
+	return retcode;
+}
+
+/** Move the window down one row. With mu the mean of the old window, u = x_new - mu, v = x_old - mu:
+ * (W - 1) C' = (W - 1) C + u u^T - v v^T - (u - v)(u - v)^T/W
+ * The matrices must not be read by anybody during the shift.
+ * **/
+int PWRwindowshift(pwrwindow *pwin)
+{
+	int j, n = pwin->n, W = pwin->window;
+	const double *xnew, *xold;
+	double *u = pwin->work, *v = &pwin->work[n], *w = &pwin->work[2*(size_t)n];
+
+	if (pwin->day + W >= pwin->T)
+		return 1;
+	xold = &pwin->returns[(size_t)pwin->day*n];
+	xnew = &pwin->returns[(size_t)(pwin->day + W)*n];
+	++pwin->day;
+
+	if (++pwin->updates >= ROLLREFRESH) {
+		if (rebuild(pwin))
+			return 1;
+	}
+	else {
+		for (j = 0; j < n; j++) {
+			u[j] = xnew[j] - pwin->mean[j];
+			v[j] = xold[j] - pwin->mean[j];
+			w[j] = u[j] - v[j];
+			pwin->mean[j] += w[j]/W;
+		}
+		PWRunsealmatrix(pwin->covmatrix, KRNpackedsize(n));
+		rank3update(n, pwin->covmatrix, 1.0/(W - 1), u, -1.0/(W - 1), v, -1.0/((double)W*(W - 1)), w);
+		PWRsealmatrix(pwin->covmatrix, KRNpackedsize(n));
+	}
+
+	if (pwin->lowmatrix != NULL) {
+		PWRunsealmatrix(pwin->lowmatrix, PWRlowercount(n, pwin->precision));
+		KRNlower(pwin->precision, KRNpackedsize(n), pwin->covmatrix, pwin->lowmatrix);
+		PWRsealmatrix(pwin->lowmatrix, PWRlowercount(n, pwin->precision));
+	}
+
+	return 0;
+}
+
+void PWRwindowfree(pwrwindow *pwin)
+{
+	PWRfreematrix(&pwin->covmatrix, KRNpackedsize(pwin->n));
+	PWRfreematrix(&pwin->lowmatrix, PWRlowercount(pwin->n, pwin->precision));
+	free(pwin->mean);
+	pwin->mean = pwin->work = NULL;
+}
+
+/** Rolling mode: one bag solves every day in turn, on the window matrices it reads in place
+ * (no perturbation, s stays zero). With n >= TEAMMINN all the threads split every matvec.
+ * Prints one line per day and the usual summary line, with the days as jobs.
+ * **/
+int PWRtrack(char *filename, int window, powerconfig *pconfig, int threads, volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex)
+{
+	int retcode = 0, T = 0, n = 0, r = pconfig->r, j, day, days = 0, interrupted = 0;
+	double *returns = NULL, loadstart, loadseconds = 0, solvestart = 0, daystart, shiftseconds;
+	long totaliterations = 0, totalmatvecs = 0;
+	powerconfig config = *pconfig;
+	powerbag *pbag = NULL;
+	pwrwindow win;
+
+	memset(&win, 0, sizeof(pwrwindow));
+	loadstart = PWRseconds();
+	if ((retcode = PWRreadreturns(filename, &T, &n, &returns)))
+		goto BACK;
+	if ((retcode = PWRwindowinit(&win, returns, T, n, window, config.precision)))
+		goto BACK;
+	loadseconds = PWRseconds() - loadstart;
+	printf("load time: %.6f s\n", loadseconds);
+	if (r > n) {
+		printf("cannot track %d eigen pairs of a %d x %d matrix\n", r, n, n); retcode = 1; goto BACK;
+	}
+
+	config.batch = 1;
+	config.sharedmatrix = 1;
+	config.warmstart = WARMRANDOM;
+	config.basevector = NULL;
+	config.lowmatrix = win.lowmatrix;
+	config.teamsize = n >= TEAMMINN && threads > 1 ? threads : 1;
+	if ((retcode = PWRallocatebag(0, n, win.covmatrix, &config, &pbag, NULL, NULL, pstop, poutputmutex)))
+		goto BACK;
+	if (config.teamsize > 1 && (retcode = PWRteamcreate(&pbag->pteam, config.teamsize, n, r, r)))
+		goto BACK;
+	printf("rolling window of %d rows over %d days, %d threads per solve\n", window, T - window + 1, config.teamsize);
+
+	/** day 0 starts from random vectors, every later day from the vectors of the day before **/
+	RNGuniform(pbag->rseed, 0, RNGBASE, 0, (size_t)r*n, pbag->vector0);
+	pbag->seed[0] = pbag->rseed;
+	pbag->warm = 0;
+
+	solvestart = PWRseconds();
+	for (day = 0; ; day++) {
+		daystart = PWRseconds();
+		if (day > 0) {
+			if (PWRwindowshift(&win))
+				break;
+			memcpy(pbag->vector0, pbag->vector, (size_t)r*n*sizeof(double));
+			pbag->warm = 1;
+		}
+		shiftseconds = PWRseconds() - daystart;
+
+		pbag->jobnumber = day;
+		pbag->batchcount = 1;
+		pbag->itercount = 0;
+		interrupted = PWRrunengine(pbag);
+		++days;
+		totaliterations += pbag->iterations[0];
+		totalmatvecs += pbag->matvecs[0];
+
+		pthread_mutex_lock(poutputmutex);
+		printf("day %d: rows %d to %d, %d matvecs, update %.6f s, solve %.6f s%s\n", day, win.day, win.day + window - 1,
+				pbag->matvecs[0], shiftseconds, PWRseconds() - daystart - shiftseconds, interrupted ? " (interrupted)" : "");
+		for (j = 0; j < r; j++)
+			printf("Day %d: Eigenvalue #%d estimate: %.12e\n", day, j+1, pbag->eigenvalue[j]);
+		pthread_mutex_unlock(poutputmutex);
+		if (interrupted)
+			break;
+	}
+
+	printf("summary: n %d jobs %d of %d workers 1 threads %d load %.6f s solve %.6f s iterations %ld matvecs %ld matrixbytes %ld%s\n",
+			n, days - interrupted, T - window + 1, config.teamsize, loadseconds, PWRseconds() - solvestart, totaliterations, totalmatvecs,
+			(long)(config.precision == PRECDOUBLE ? KRNpackedsize(n)*sizeof(double) : PWRlowercount(n, config.precision)*sizeof(double)),
+			interrupted ? " interrupted" : "");
+
+	BACK:
+	if (pbag != NULL)
+		PWRteamdestroy(&pbag->pteam);
+	PWRfreebag(&pbag);
+	PWRwindowfree(&win);
+	free(returns);
+	return retcode;
+}
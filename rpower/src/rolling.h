@@ -0,0 +1,37 @@
+#ifndef ROLLING
+#define ROLLING
+
+#include <signal.h>
+#include <pthread.h>
+#include "power.h"
+
+/** Rolling window tracking (rpower returns -R window): the file holds T x n returns, day d is the
+ * covariance of rows d .. d + window - 1. Day 0 is built by PWRcovariance and solved from random
+ * vectors. Moving the window by one row changes the covariance by a rank 3 update (the new row
+ * in, the old row out, the shift of the mean), applied in place in one pass over the packed
+ * matrix, and the eigen pairs of the day before are re-converged from there (a warm start, a few
+ * matvecs instead of a cold solve). Every ROLLREFRESH days the covariance is rebuilt from the
+ * window, which drops the rounding accumulated by the updates.
+ * **/
+
+#define ROLLREFRESH 256
+
+typedef struct pwrwindow{
+	int T, n;
+	int window;
+	int day; /** first row of the window **/
+	const double *returns; /** T x n, row major **/
+	double *mean; /** n, of the rows in the window **/
+	double *work; /** 3 x n update vectors **/
+	double *covmatrix; /** packed covariance of the window, sealed but while it is updated **/
+	int precision;
+	double *lowmatrix; /** its rounded copy, NULL for PRECDOUBLE **/
+	int updates; /** since the last rebuild **/
+}pwrwindow;
+
+int PWRwindowinit(pwrwindow *pwin, const double *returns, int T, int n, int window, int precision);
+int PWRwindowshift(pwrwindow *pwin);
+void PWRwindowfree(pwrwindow *pwin);
+int PWRtrack(char *filename, int window, powerconfig *pconfig, int threads, volatile sig_atomic_t *pstop, pthread_mutex_t *poutputmutex);
+
+#endif
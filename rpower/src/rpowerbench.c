@@ -0,0 +1,398 @@
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "utilities.h"
+#include "kernels.h"
+#include "matio.h"
+#include "topology.h"
+
+/** End to end benchmark: runs rpower over the bundled data files and synthetic matrices for every
+ * combination of engine, workers, r, tolerance and scale, and writes one CSV line per run from the
+ * "load time" and "summary" lines rpower prints.
+ * The synthetic matrices are factor models (a few strong factors plus a diagonal, so that the top
+ * eigen values are well separated) written once in the binary format to the work directory.
+ * The file column names a run's matrix independently of the machine: data/<name> for the bundled
+ * files whatever -d is, synthetic-n<n>-seed<seed> for the generated ones.
+ * With -c, runs are matched by their parameters against a CSV written earlier and the solve
+ * time ratio is added, which is how a kernel or scheduler change is compared to a stored baseline.
+ * With -P float,bf16 every run is repeated with the matrix stored in each precision, after the run in
+ * double, and max_rel_error is the largest relative difference of an eigen value estimate of any job
+ * from the double run (same seed, so the same jobs): what the cheaper storage costs in accuracy.
+ * usage: rpowerbench [-p rpower] [-d datadir] [-D workdir] [-o out.csv] [-c baseline.csv] [-n max synthetic n]
+ *                    [-e engines] [-w workers] [-r eigen values] [-t tolerances] [-s scales] [-q quantity] [-x "rpower options"]
+ *                    [-P matrix precisions]
+ * lists are comma separated, e.g. -w 1,2,4; the default workers are 1, the cpus of one NUMA node and
+ * all the cpus, to be run with and without -x "-N compact" to see what the placement gains
+ * **/
+
+#define BENCHMAXLIST 16
+#define BENCHFACTORS 8
+#define BENCHKEY 512
+#define BENCHLINE 4096
+#define BENCHSEED 4739 /** of the synthetic matrices **/
+#define BENCHPRECISION 18 /** field of the precision in a CSV line, after the figures of rpower **/
+
+static char *bundled[] = {"size4.dat", "size10.dat", "size20.dat", "size100.dat", "size500.dat"};
+static int synthetic[] = {1000, 2000, 5000, 10000};
+
+typedef struct benchrun{
+	int retcode;
+	int n;
+	int jobs;
+	int workers; /** after rpower's own adjustment **/
+	int threads;
+	double load;
+	double solve;
+	long iterations;
+	long matvecs;
+	long matrixbytes;
+	int neigen; /** eigen value estimates read, job k's #j at eigen[k*r + j - 1] **/
+	double *eigen;
+}benchrun;
+
+typedef struct benchbaseline{
+	int count;
+	char **key;
+	double *solve;
+}benchbaseline;
+
+static int splitlist(char *list, char **item)
+{
+	int count = 0;
+	char *token;
+
+	for (token = strtok(list, ","); token != NULL && count < BENCHMAXLIST; token = strtok(NULL, ","))
+		item[count++] = token;
+
+	return count;
+}
+
+/** factor model B diag(f) B^T + diag(d) with factor variances 64, 32, ..., the same for the same n and seed **/
+static int writesynthetic(char *filename, int n, unsigned int seed)
+{
+	int retcode = 0, i, j, k;
+	double *b = NULL, *packed = NULL, sum;
+
+	b = (double *)malloc((size_t)n*BENCHFACTORS*sizeof(double));
+	packed = PWRallocmatrix(KRNpackedsize(n));
+	if (!b || !packed) {
+		printf("no memory for the synthetic matrix n = %d\n", n);
+		retcode = 1; goto BACK;
+	}
+
+	for (i = 0; i < n; i++)
+		for (k = 0; k < BENCHFACTORS; k++)
+			b[(size_t)i*BENCHFACTORS + k] = (rand_r(&seed)/((double) RAND_MAX) - 0.5)*sqrt(12.0/n)*sqrt(64.0/(1 << k));
+
+	for (i = 0; i < n; i++)
+		for (j = i; j < n; j++) {
+			sum = (i == j) ? 0.01*(1 + rand_r(&seed)/((double) RAND_MAX)) : 0;
+			for (k = 0; k < BENCHFACTORS; k++)
+				sum += b[(size_t)i*BENCHFACTORS + k]*b[(size_t)j*BENCHFACTORS + k];
+			packed[KRNrowoffset(n, i) + j - i] = sum;
+		}
+
+	retcode = PWRwritebinary(filename, n, packed);
+
+	BACK:
+	free(b);
+	PWRfreematrix(&packed, KRNpackedsize(n));
+	return retcode;
+}
+
+/** runs rpower once and picks the figures out of its output; eigen holds room for quantity*r estimates **/
+static int runrpower(char *command, int quantity, int r, double *eigen, benchrun *prun)
+{
+	FILE *output;
+	char line[BENCHLINE];
+	int status, job, index;
+	double value;
+
+	memset(prun, 0, sizeof(benchrun));
+	prun->retcode = -1;
+	prun->eigen = eigen;
+
+	output = popen(command, "r");
+	if (output == NULL)
+		return 1;
+
+	while (fgets(line, sizeof(line), output) != NULL) {
+		if (0 == strncmp(line, "load time:", 10))
+			sscanf(line, "load time: %lf", &prun->load);
+		else if (0 == strncmp(line, "summary:", 8))
+			sscanf(line, "summary: n %d jobs %d of %*d workers %d threads %d load %*f s solve %lf s iterations %ld matvecs %ld matrixbytes %ld",
+					&prun->n, &prun->jobs, &prun->workers, &prun->threads, &prun->solve, &prun->iterations, &prun->matvecs, &prun->matrixbytes);
+		else if (3 == sscanf(line, "Job %d: Eigenvalue #%d estimate: %lf", &job, &index, &value)
+				&& job >= 0 && job < quantity && index >= 1 && index <= r) {
+			eigen[job*r + index - 1] = value;
+			++prun->neigen;
+		}
+	}
+
+	status = pclose(output);
+	prun->retcode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+	return 0;
+}
+
+/** largest relative difference of the estimates from the reference run, -1 if they cannot be compared **/
+static double relativeerror(benchrun *prun, benchrun *preference, int count)
+{
+	int j;
+	double error = 0, difference;
+
+	if (prun->neigen != count || preference->neigen != count || count == 0)
+		return -1;
+
+	for (j = 0; j < count; j++) {
+		difference = fabs(prun->eigen[j] - preference->eigen[j]);
+		if (preference->eigen[j] != 0)
+			difference /= fabs(preference->eigen[j]);
+		if (difference > error)
+			error = difference;
+	}
+
+	return error;
+}
+
+/** start of the field of a CSV line counted from 0, NULL if the line is shorter **/
+static char *csvfield(char *line, int index)
+{
+	for (; line && index > 0; index--)
+		if ((line = strchr(line, ',')))
+			++line;
+	return line;
+}
+
+/** the first eight fields of a CSV line and its precision identify a run; a line written before
+ * the precision column was added is a double run **/
+static void runkey(char *line, char *key)
+{
+	char *end = csvfield(line, 8), *precision = csvfield(line, BENCHPRECISION);
+	int length = end ? (int)(end - line) - 1 : (int)strcspn(line, "\n");
+
+	if (precision && strcspn(precision, ",\n") > 0)
+		snprintf(key, BENCHKEY, "%.*s,%.*s", length, line, (int)strcspn(precision, ",\n"), precision);
+	else
+		snprintf(key, BENCHKEY, "%.*s,double", length, line);
+}
+
+static int readbaseline(char *filename, benchbaseline *pbaseline)
+{
+	FILE *input;
+	char line[BENCHLINE], key[BENCHKEY], *field;
+	int retcode = 0;
+
+	if ((input = fopen(filename, "r")) == NULL) {
+		printf("cannot open baseline %s\n", filename);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), input) != NULL) {
+		if (0 == strncmp(line, "file,", 5))
+			continue;
+		runkey(line, key);
+		/** solve_s is the twelfth field **/
+		if ((field = csvfield(line, 11)) == NULL)
+			continue;
+
+		pbaseline->key = (char **)realloc(pbaseline->key, (pbaseline->count + 1)*sizeof(char *));
+		pbaseline->solve = (double *)realloc(pbaseline->solve, (pbaseline->count + 1)*sizeof(double));
+		if (!pbaseline->key || !pbaseline->solve) {
+			printf("no memory for the baseline\n");
+			retcode = 1; goto BACK;
+		}
+		pbaseline->key[pbaseline->count] = strdup(key);
+		pbaseline->solve[pbaseline->count] = atof(field);
+		++pbaseline->count;
+	}
+
+	BACK:
+	fclose(input);
+	return retcode;
+}
+
+static void freebaseline(benchbaseline *pbaseline)
+{
+	int j;
+
+	for (j = 0; j < pbaseline->count; j++)
+		free(pbaseline->key[j]);
+	free(pbaseline->key);
+	free(pbaseline->solve);
+}
+
+int main(int argc, char *argv[])
+{
+	int retcode = 0, j, f, e, w, r, t, s, p, b, quantity = 8, maxn = 10000, nfiles = 0, maxr = 0;
+	char *rpower = "bin/rpower", *datadir = "data", *workdir = "/tmp", *outname = NULL, *baselinename = NULL, *extra = "";
+	char enginelist[256] = "power", workerlist[256] = "1", rlist[256] = "1,4", tlist[256] = "1e-6", slist[256] = "1";
+	char precisionlist[256] = "double";
+	char *engine[BENCHMAXLIST], *workers[BENCHMAXLIST], *rs[BENCHMAXLIST], *tolerance[BENCHMAXLIST], *scale[BENCHMAXLIST];
+	char *precision[BENCHMAXLIST + 1];
+	int nengine, nworkers, nr, ntolerance, nscale, nprecision;
+	char *file[sizeof(bundled)/sizeof(char *) + sizeof(synthetic)/sizeof(int)];
+	char *label[sizeof(bundled)/sizeof(char *) + sizeof(synthetic)/sizeof(int)]; /** file column of the CSV **/
+	char command[BENCHLINE], line[BENCHLINE], key[BENCHKEY];
+	struct stat st;
+	pwrtopology topology;
+	benchrun run, reference;
+	benchbaseline baseline;
+	double *eigen = NULL, *referenceeigen = NULL, error;
+	FILE *out = stdout;
+
+	memset(&baseline, 0, sizeof(benchbaseline));
+	memset(file, 0, sizeof(file));
+	memset(label, 0, sizeof(label));
+
+	/** default workers: one, one socket, every socket **/
+	if (PWRtopologyinit(&topology, PLACECOMPACT) == 0) {
+		if (topology.nnodes > 1)
+			snprintf(workerlist, sizeof(workerlist), "1,%d,%d", topology.nodecpus[0], topology.ncpus);
+		else if (topology.ncpus > 1)
+			snprintf(workerlist, sizeof(workerlist), "1,%d", topology.ncpus);
+		PWRtopologyfree(&topology);
+	}
+
+	for (j = 1; j < argc; j++) {
+		if (j + 1 >= argc) {
+			printf("option %s needs a value\n", argv[j]); retcode = 1; goto BACK;
+		}
+		if (0 == strcmp(argv[j], "-p")) rpower = argv[++j];
+		else if (0 == strcmp(argv[j], "-d")) datadir = argv[++j];
+		else if (0 == strcmp(argv[j], "-D")) workdir = argv[++j];
+		else if (0 == strcmp(argv[j], "-o")) outname = argv[++j];
+		else if (0 == strcmp(argv[j], "-c")) baselinename = argv[++j];
+		else if (0 == strcmp(argv[j], "-n")) maxn = atoi(argv[++j]);
+		else if (0 == strcmp(argv[j], "-q")) quantity = atoi(argv[++j]);
+		else if (0 == strcmp(argv[j], "-x")) extra = argv[++j];
+		else if (0 == strcmp(argv[j], "-e")) snprintf(enginelist, sizeof(enginelist), "%s", argv[++j]);
+		else if (0 == strcmp(argv[j], "-w")) snprintf(workerlist, sizeof(workerlist), "%s", argv[++j]);
+		else if (0 == strcmp(argv[j], "-r")) snprintf(rlist, sizeof(rlist), "%s", argv[++j]);
+		else if (0 == strcmp(argv[j], "-t")) snprintf(tlist, sizeof(tlist), "%s", argv[++j]);
+		else if (0 == strcmp(argv[j], "-s")) snprintf(slist, sizeof(slist), "%s", argv[++j]);
+		else if (0 == strcmp(argv[j], "-P")) snprintf(precisionlist, sizeof(precisionlist), "%s", argv[++j]);
+		else {
+			printf(" usage: rpowerbench [-p rpower] [-d datadir] [-D workdir] [-o out.csv] [-c baseline.csv] [-n max synthetic n] [-e engines] [-w workers] [-r eigen values] [-t tolerances] [-s scales] [-q quantity] [-x \"rpower options\"] [-P matrix precisions]\n");
+			retcode = 1; goto BACK;
+		}
+	}
+
+	nengine = splitlist(enginelist, engine);
+	nworkers = splitlist(workerlist, workers);
+	nr = splitlist(rlist, rs);
+	ntolerance = splitlist(tlist, tolerance);
+	nscale = splitlist(slist, scale);
+
+	/** the double run comes first, it is the reference of the others **/
+	precision[0] = "double";
+	nprecision = 1;
+	for (p = 0, b = splitlist(precisionlist, &precision[1]); p < b; p++)
+		if (strcmp(precision[1 + p], "double"))
+			precision[nprecision++] = precision[1 + p];
+
+	for (r = 0; r < nr; r++)
+		if (atoi(rs[r]) > maxr)
+			maxr = atoi(rs[r]);
+	eigen = (double *)calloc((size_t)quantity*maxr + 1, sizeof(double));
+	referenceeigen = (double *)calloc((size_t)quantity*maxr + 1, sizeof(double));
+	if (!eigen || !referenceeigen) {
+		printf("no memory for the eigen values\n");
+		retcode = 1; goto BACK;
+	}
+
+	if (baselinename && (retcode = readbaseline(baselinename, &baseline)))
+		goto BACK;
+
+	/** the bundled files, then the synthetic ones, generated the first time **/
+	for (f = 0; f < (int)(sizeof(bundled)/sizeof(char *)); f++) {
+		snprintf(command, sizeof(command), "%s/%s", datadir, bundled[f]);
+		if (stat(command, &st) == 0) {
+			file[nfiles] = strdup(command);
+			snprintf(command, sizeof(command), "data/%s", bundled[f]);
+			label[nfiles++] = strdup(command);
+		}
+		else
+			printf("rpowerbench: %s not found, skipped\n", command);
+	}
+	for (f = 0; f < (int)(sizeof(synthetic)/sizeof(int)) && synthetic[f] <= maxn; f++) {
+		snprintf(command, sizeof(command), "%s/rpowerbench%d-%d.bin", workdir, synthetic[f], BENCHSEED);
+		if (stat(command, &st) != 0) {
+			printf("rpowerbench: writing synthetic matrix %s\n", command);
+			if ((retcode = writesynthetic(command, synthetic[f], BENCHSEED)))
+				goto BACK;
+		}
+		file[nfiles] = strdup(command);
+		snprintf(command, sizeof(command), "synthetic-n%d-seed%d", synthetic[f], BENCHSEED);
+		label[nfiles++] = strdup(command);
+	}
+
+	if (outname && (out = fopen(outname, "w")) == NULL) {
+		printf("cannot open %s\n", outname);
+		out = stdout;
+		retcode = 1; goto BACK;
+	}
+
+	fprintf(out, "file,options,engine,workers,r,tolerance,scale,quantity,n,retcode,load_s,solve_s,jobs,iterations,matvecs,s_per_iteration,jobs_per_s,gb_per_s,precision,max_rel_error%s\n",
+			baselinename ? ",baseline_solve_s,speedup" : "");
+	fflush(out);
+
+	for (f = 0; f < nfiles; f++)
+	for (e = 0; e < nengine; e++)
+	for (w = 0; w < nworkers; w++)
+	for (r = 0; r < nr; r++)
+	for (t = 0; t < ntolerance; t++)
+	for (s = 0; s < nscale; s++)
+	for (p = 0; p < nprecision; p++) {
+		snprintf(command, sizeof(command), "%s %s -e %s -w %s -r %s -t %s -s %s -q %d -p %s %s 2>&1", rpower, file[f],
+				engine[e], workers[w], rs[r], tolerance[t], scale[s], quantity, precision[p], extra);
+		if (out != stdout) {
+			printf("rpowerbench: %s\n", command);
+			fflush(stdout);
+		}
+		if (p == 0) {
+			runrpower(command, quantity, atoi(rs[r]), referenceeigen, &reference);
+			run = reference;
+		}
+		else
+			runrpower(command, quantity, atoi(rs[r]), eigen, &run);
+		error = relativeerror(&run, &reference, quantity*atoi(rs[r]));
+
+		/** time per iteration as seen by one worker, traffic as if every matvec streamed the matrix **/
+		snprintf(line, sizeof(line), "%s,%s,%s,%s,%s,%s,%s,%d,%d,%d,%.6f,%.6f,%d,%ld,%ld,%.6e,%.3f,%.3f",
+				label[f], extra, engine[e], workers[w], rs[r], tolerance[t], scale[s], quantity,
+				run.n, run.retcode, run.load, run.solve, run.jobs, run.iterations, run.matvecs,
+				run.iterations ? run.solve*run.workers/run.iterations : 0,
+				run.solve > 0 ? run.jobs/run.solve : 0,
+				run.solve > 0 ? (double)run.matvecs*run.matrixbytes/run.solve*1e-9 : 0);
+		j = (int)strlen(line);
+		if (error >= 0)
+			snprintf(line + j, sizeof(line) - j, ",%s,%.6e", precision[p], error);
+		else
+			snprintf(line + j, sizeof(line) - j, ",%s,", precision[p]);
+		fprintf(out, "%s", line);
+		if (baselinename) {
+			runkey(line, key);
+			for (b = 0; b < baseline.count && strcmp(baseline.key[b], key); b++);
+			if (b < baseline.count)
+				fprintf(out, ",%.6f,%.3f", baseline.solve[b], run.solve > 0 ? baseline.solve[b]/run.solve : 0);
+			else
+				fprintf(out, ",,");
+		}
+		fprintf(out, "\n");
+		fflush(out);
+	}
+
+	BACK:
+	if (out != stdout)
+		fclose(out);
+	for (f = 0; f < nfiles; f++) {
+		free(file[f]);
+		free(label[f]);
+	}
+	freebaseline(&baseline);
+	free(eigen);
+	free(referenceeigen);
+	return retcode;
+}
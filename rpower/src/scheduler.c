@@ -0,0 +1,170 @@
+#include <pthread.h>
+#include "utilities.h"
+#include "power.h"
+#include "scheduler.h"
+
+static const char *reasonname[STOPHOPELESS + 1] = {"none", "iteration cap", "signal", "over budget", "deadline", "hopeless"};
+
+/** deadline in seconds from now, 0 for none **/
+int PWRschedinit(pwrscheduler *psched, double budget, double deadline)
+{
+	memset(psched, 0, sizeof(pwrscheduler));
+	psched->budget = budget > 0 ? budget : 0;
+	psched->deadline = deadline > 0 ? PWRseconds() + deadline : 0;
+	pthread_mutex_init(&psched->mutex, NULL);
+
+	return 0;
+}
+
+void PWRschedfree(pwrscheduler *psched)
+{
+	pthread_mutex_destroy(&psched->mutex);
+}
+
+const char *PWRschedreason(int stopreason)
+{
+	return reasonname[stopreason];
+}
+
+/** "job[-job]:priority,..." sets the priority of single jobs or ranges, the others have 0 **/
+int PWRschedpriorities(char *spec, int quantity, int *priority)
+{
+	char *p = spec, *stop;
+	long first, last, value;
+
+	memset(priority, 0, quantity*sizeof(int));
+	while (*p) {
+		first = last = strtol(p, &stop, 10);
+		if (stop == p)
+			goto BAD;
+		p = stop;
+		if (*p == '-') {
+			last = strtol(p + 1, &stop, 10);
+			if (stop == p + 1)
+				goto BAD;
+			p = stop;
+		}
+		if (*p != ':')
+			goto BAD;
+		value = strtol(p + 1, &stop, 10);
+		if (stop == p + 1 || first < 0 || last < first)
+			goto BAD;
+		p = stop;
+		for (; first <= last && first < quantity; first++)
+			priority[first] = (int) value;
+		if (*p == ',')
+			p++;
+		else if (*p)
+			goto BAD;
+	}
+	return 0;
+
+	BAD:
+	printf("bad priorities \"%s\" at \"%s\", expected job[-job]:priority,...\n", spec, p);
+	return 1;
+}
+
+/** a free worker asks before starting a batch of count jobs: 0 if it cannot finish before the
+ * deadline, judging from the jobs done so far (with none done yet every job is given its chance);
+ * *pleft and *pmean receive the seconds left and the mean time of a job, for the worker to report
+ * **/
+int PWRschedadmit(pwrscheduler *psched, int count, double *pleft, double *pmean)
+{
+	int admit = 1;
+	double left = 0, mean = 0;
+
+	*pleft = *pmean = 0;
+	if (psched == NULL || psched->deadline == 0)
+		return 1;
+
+	pthread_mutex_lock(&psched->mutex);
+	left = psched->deadline - PWRseconds();
+	mean = psched->jobsdone > 0 ? psched->jobseconds/psched->jobsdone : 0;
+	if (left <= 0 || mean*count > left) {
+		admit = 0;
+		psched->dropped += count;
+	}
+	pthread_mutex_unlock(&psched->mutex);
+	*pleft = left;
+	*pmean = mean;
+
+	return admit;
+}
+
+void PWRschedstart(pwrprogress *pprogress, int jobs)
+{
+	memset(pprogress, 0, sizeof(pwrprogress));
+	pprogress->start = pprogress->windowtime = PWRseconds();
+	pprogress->jobs = jobs;
+	pprogress->windowk = -1;
+	pprogress->estimate = -1;
+}
+
+/** called at every iteration k of a job with the error the engine tests against the tolerance
+ * (the power method starts k again at every pair, which starts a new window); returns the
+ * reason to stop the job, STOPNONE to go on
+ * **/
+int PWRschedcheck(pwrscheduler *psched, pwrprogress *pprogress, int k, double error, double tolerance)
+{
+	double now = PWRseconds(), left = HUGE_VAL, rate, periteration;
+
+	if (psched->budget > 0) {
+		left = psched->budget*pprogress->jobs - (now - pprogress->start);
+		if (left <= 0)
+			return STOPBUDGET;
+	}
+	if (psched->deadline > 0) {
+		if (now >= psched->deadline)
+			return STOPDEADLINE;
+		if (psched->deadline - now < left)
+			left = psched->deadline - now;
+	}
+
+	if (k < pprogress->windowk || pprogress->windowk < 0 || !(error > 0)) {
+		/** first iteration, a new pair, or nothing to measure **/
+		pprogress->windowk = k;
+		pprogress->windowerror = error;
+		pprogress->windowtime = now;
+		pprogress->stalls = 0;
+		return STOPNONE;
+	}
+	if (k - pprogress->windowk < SCHEDWINDOW)
+		return STOPNONE;
+
+	/** error ~ exp(-rate k): projected iterations to the tolerance at the measured time per iteration;
+	 * measured against the best error of the pair so far, an error bouncing around a floor makes no progress **/
+	rate = (log(pprogress->windowerror) - log(error))/(k - pprogress->windowk);
+	periteration = (now - pprogress->windowtime)/(k - pprogress->windowk);
+	pprogress->windowk = k;
+	if (error < pprogress->windowerror)
+		pprogress->windowerror = error;
+	pprogress->windowtime = now;
+	if (error < tolerance)
+		return STOPNONE;
+
+	if (rate <= 0) {
+		pprogress->estimate = -1;
+		if (++pprogress->stalls >= SCHEDSTALLS && left < HUGE_VAL)
+			return STOPHOPELESS;
+		return STOPNONE;
+	}
+	pprogress->stalls = 0;
+	pprogress->estimate = log(error/tolerance)/rate*periteration;
+	if (pprogress->estimate > SCHEDMARGIN*left)
+		return STOPHOPELESS;
+
+	return STOPNONE;
+}
+
+/** end of a job: the time of the jobs done feeds PWRschedadmit **/
+void PWRschedjobdone(pwrscheduler *psched, pwrprogress *pprogress, int stopreason)
+{
+	pthread_mutex_lock(&psched->mutex);
+	if (stopreason == STOPNONE) {
+		psched->jobseconds += PWRseconds() - pprogress->start;
+		psched->jobsdone += pprogress->jobs;
+	}
+	else
+		psched->stopped[stopreason] += pprogress->jobs;
+	pthread_mutex_unlock(&psched->mutex);
+}
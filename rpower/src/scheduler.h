@@ -0,0 +1,61 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+
+#include <pthread.h>
+
+/** Job scheduling with wall clock limits and priorities, replacing the fixed iteration cap:
+ * - every job may run for -B seconds at most, and nothing runs past the deadline of the run (-D)
+ * - the decay of the error of a job is measured over windows of SCHEDWINDOW iterations; a job
+ *   whose error stopped decreasing for SCHEDSTALLS windows, or whose projected time to reach
+ *   the tolerance exceeds SCHEDMARGIN times what is left of its budget or of the deadline, is
+ *   hopeless and stopped early (interrupted, so that a checkpoint keeps its iterates)
+ * - the jobs are queued by decreasing priority (-P), and a worker that frees up skips the queued
+ *   jobs that cannot finish before the deadline given the mean time of the jobs done so far,
+ *   leaving the time to the ones that can
+ * -X still caps the iterations of a job, 100000 by default when neither -B nor -D is given.
+ * **/
+
+#define SCHEDWINDOW 50 /** iterations between two estimates of the decay rate **/
+#define SCHEDSTALLS 3
+#define SCHEDMARGIN 2.0
+#define SCHEDMAXITERATIONS 100000 /** default cap without time limits **/
+
+/** reasons to stop a job **/
+#define STOPNONE 0
+#define STOPITERATIONS 1
+#define STOPSIGNAL 2
+#define STOPBUDGET 3
+#define STOPDEADLINE 4
+#define STOPHOPELESS 5
+
+typedef struct pwrscheduler{
+	double budget; /** seconds per job, 0 for none **/
+	double deadline; /** PWRseconds at which the run stops, 0 for none **/
+	pthread_mutex_t mutex;
+	double jobseconds; /** total time of the jobs done **/
+	long jobsdone;
+	long dropped; /** jobs skipped because of the deadline **/
+	long stopped[STOPHOPELESS + 1]; /** jobs stopped, by reason **/
+}pwrscheduler;
+
+/** progress of the job of a worker **/
+typedef struct pwrprogress{
+	double start; /** PWRseconds at the start of the job **/
+	int jobs; /** jobs of the batch, which gets that many budgets **/
+	int windowk; /** iteration and time at the start of the current window **/
+	double windowerror; /** best error of the pair at the window starts **/
+	double windowtime;
+	int stalls; /** windows in a row without progress **/
+	double estimate; /** projected seconds to the tolerance at the end of the last window, -1 if unknown **/
+}pwrprogress;
+
+int PWRschedinit(pwrscheduler *psched, double budget, double deadline);
+void PWRschedfree(pwrscheduler *psched);
+int PWRschedpriorities(char *spec, int quantity, int *priority);
+int PWRschedadmit(pwrscheduler *psched, int count, double *pleft, double *pmean);
+void PWRschedstart(pwrprogress *pprogress, int jobs);
+int PWRschedcheck(pwrscheduler *psched, pwrprogress *pprogress, int k, double error, double tolerance);
+void PWRschedjobdone(pwrscheduler *psched, pwrprogress *pprogress, int stopreason);
+const char *PWRschedreason(int stopreason);
+
+#endif
@@ -0,0 +1,112 @@
+#include <pthread.h>
+#include "utilities.h"
+#include "power.h"
+#include "sink.h"
+
+static int writeresult(pwrsink *psink, powerresult *presult)
+{
+	int b, n = presult->n, r = presult->r;
+	pwrresrecord record;
+
+	for (b = 0; b < presult->count; b++) {
+		record.jobnumber = presult->jobnumber + b;
+		record.seed = presult->seed[b];
+		record.iterations = presult->iterations[b];
+		record.matvecs = presult->matvecs[b];
+		record.worker = presult->ID;
+		record.interrupted = presult->interrupted;
+		if (fwrite(&record, sizeof(record), 1, psink->file) != 1
+				|| fwrite(&presult->eigenvalue[b*r], sizeof(double), r, psink->file) != (size_t)r
+				|| fwrite(&presult->perturbation[(size_t)b*n], sizeof(double), n, psink->file) != (size_t)n
+				|| fwrite(&presult->eigenvector[(size_t)b*r*n], sizeof(double), (size_t)r*n, psink->file) != (size_t)r*n)
+			return 1;
+		++psink->records;
+	}
+
+	return 0;
+}
+
+/** writer thread: drains the queue until it is closed, every result goes back to its worker **/
+static void *writer(void *pvoidedsink)
+{
+	pwrsink *psink = (pwrsink *) pvoidedsink;
+	powerresult *presult;
+
+	while ((presult = (powerresult *) PWRqueuepop(&psink->queue)) != NULL) {
+		if (!psink->failed && writeresult(psink, presult)) {
+			printf("result sink: write failed after %ld records, the next results are dropped\n", psink->records);
+			psink->failed = 1;
+		}
+		PWRreleaseresult(presult);
+	}
+
+	return NULL;
+}
+
+/** capacity: results that can be queued at once, the number of batches of the run so that pushing never waits **/
+int PWRsinkopen(pwrsink *psink, char *filename, int n, int r, double scale, int capacity)
+{
+	int retcode = 0;
+	pwrresheader header;
+
+	memset(psink, 0, sizeof(pwrsink));
+
+	if ((psink->file = fopen(filename, "wb")) == NULL) {
+		printf("cannot open result file %s\n", filename);
+		retcode = 1; goto BACK;
+	}
+	if ((psink->buffer = (char *)malloc(RESBUFFER)) == NULL || PWRqueueinit(&psink->queue, capacity, 1)) {
+		printf("no memory for the result sink\n");
+		retcode = NOMEMORY; goto BACK;
+	}
+	setvbuf(psink->file, psink->buffer, _IOFBF, RESBUFFER);
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RESMAGIC, sizeof(header.magic));
+	header.version = RESVERSION;
+	header.byteorder = MATBYTEORDER;
+	header.n = n;
+	header.r = r;
+	header.scale = scale;
+	if (fwrite(&header, sizeof(header), 1, psink->file) != 1) {
+		printf("cannot write result file %s\n", filename);
+		retcode = 1; goto BACK;
+	}
+
+	if (pthread_create(&psink->writer, NULL, &writer, (void *) psink)) {
+		printf("cannot start the result writer\n");
+		retcode = 1; goto BACK;
+	}
+	psink->started = 1;
+
+	BACK:
+	if (retcode)
+		PWRsinkclose(psink);
+	return retcode;
+}
+
+int PWRsinkpush(pwrsink *psink, powerresult *presult)
+{
+	return PWRqueuepush(&psink->queue, presult);
+}
+
+/** waits for the writer to drain the queue, returns 1 if anything could not be written **/
+int PWRsinkclose(pwrsink *psink)
+{
+	int retcode = 0;
+
+	if (psink->started) {
+		PWRqueueclose(&psink->queue);
+		pthread_join(psink->writer, NULL);
+		psink->started = 0;
+	}
+	if (psink->file != NULL) {
+		retcode = fclose(psink->file) != 0 || psink->failed;
+		psink->file = NULL;
+	}
+	PWRqueuedestroy(&psink->queue);
+	free(psink->buffer);
+	psink->buffer = NULL;
+
+	return retcode;
+}
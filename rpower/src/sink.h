@@ -0,0 +1,53 @@
+#ifndef SINK
+#define SINK
+
+#include <stdint.h>
+#include <pthread.h>
+#include "power.h"
+
+/** Result sink: the master hands every powerresult to a writer thread, which appends it to a
+ * binary file through a large stdio buffer and gives it back to its worker (PWRreleaseresult).
+ * The queue holds every batch of the run, so neither the master nor the workers wait for the disk.
+ * File layout, native byte order (checked with byteorder like the matrix files of matio.h):
+ *   pwrresheader
+ *   then one record per job, in completion order, each of the same size:
+ *     pwrresrecord, r eigen values, the n entries of the perturbation s, the r x n eigen vectors (doubles)
+ * **/
+
+#define RESMAGIC "RPWRRES" /** 8 bytes with the terminating 0 **/
+#define RESVERSION 1
+#define RESBUFFER (1 << 22) /** stdio buffer of the writer **/
+
+typedef struct pwrresheader{
+	char magic[8];
+	uint32_t version;
+	uint32_t byteorder; /** MATBYTEORDER **/
+	uint32_t n;
+	uint32_t r;
+	double scale; /** of the perturbations **/
+}pwrresheader;
+
+typedef struct pwrresrecord{
+	uint32_t jobnumber;
+	uint32_t seed; /** seed of the run, the perturbation is stream RNGPERTURBATION of (seed, jobnumber), see random.h **/
+	uint32_t iterations;
+	uint32_t matvecs;
+	uint32_t worker;
+	uint32_t interrupted;
+}pwrresrecord;
+
+typedef struct pwrsink{
+	FILE *file;
+	char *buffer;
+	pwrqueue queue;
+	pthread_t writer;
+	int started;
+	long records;
+	int failed; /** a write failed, the remaining results are only released **/
+}pwrsink;
+
+int PWRsinkopen(pwrsink *psink, char *filename, int n, int r, double scale, int capacity);
+int PWRsinkpush(pwrsink *psink, powerresult *presult);
+int PWRsinkclose(pwrsink *psink);
+
+#endif
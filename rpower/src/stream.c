@@ -0,0 +1,243 @@
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "matio.h"
+#include "stream.h"
+
+/** reads and checks the header of a packed binary matrix file; fd is left open in *pfd if not NULL **/
+static int openpacked(char *filename, int *pfd, pwrmatheader *pheader)
+{
+	int fd;
+	struct stat filestat;
+
+	if ((fd = open(filename, O_RDONLY)) < 0) {
+		printf("cannot open file %s\n", filename); return 1;
+	}
+	if (fstat(fd, &filestat) || pread(fd, pheader, sizeof(pwrmatheader), 0) != sizeof(pwrmatheader)
+			|| memcmp(pheader->magic, MATMAGIC, sizeof(pheader->magic))) {
+		printf("%s is not a binary matrix file, convert it with convertmat first\n", filename); goto BAD;
+	}
+	if (pheader->version != MATVERSION || pheader->byteorder != MATBYTEORDER || pheader->dtype != MATFLOAT64
+			|| (pheader->flags & (MATPACKED | MATSYMMETRIC | MATRETURNS | MATFACTORS)) != (MATPACKED | MATSYMMETRIC)) {
+		printf("%s: out of core runs need a packed symmetric matrix file\n", filename); goto BAD;
+	}
+	if (pheader->n == 0 || pheader->n > 1000000 || pheader->databytes != KRNpackedsize(pheader->n)*sizeof(double)
+			|| pheader->dataoffset < sizeof(pwrmatheader) || pheader->dataoffset + pheader->databytes > (uint64_t) filestat.st_size) {
+		printf("%s: bad dimension or data size\n", filename); goto BAD;
+	}
+	*pfd = fd;
+	return 0;
+
+	BAD:
+	close(fd);
+	return 1;
+}
+
+/** dimension and checksum of the matrix of an out of core run, nothing is read but the header **/
+int PWRstreamprobe(char *filename, int *pn, uint64_t *pchecksum)
+{
+	int fd;
+	pwrmatheader header;
+
+	if (openpacked(filename, &fd, &header))
+		return 1;
+	close(fd);
+	*pn = (int) header.n;
+	*pchecksum = header.checksum;
+	printf("out of core matrix %s: n = %d, %.1f MB streamed per sweep\n", filename, *pn, header.databytes/1048576.0);
+
+	return 0;
+}
+
+/** *pbytes receives the size of the band, even if the read fails **/
+static int readband(pwrstream *pstream, int band, double *buffer, size_t *pbytes)
+{
+	int n = pstream->n;
+	size_t bytes = (KRNrowoffset(n, pstream->bandrow[band + 1] - 1) + n - pstream->bandrow[band + 1] + 1 - KRNrowoffset(n, pstream->bandrow[band]))*sizeof(double);
+	off_t offset = pstream->dataoffset + (off_t) KRNrowoffset(n, pstream->bandrow[band])*sizeof(double);
+	char *p = (char *) buffer;
+	ssize_t got;
+
+	*pbytes = bytes;
+	while (bytes > 0) {
+		got = pread(pstream->fd, p, bytes, offset);
+		if (got <= 0)
+			return 1;
+		p += got;
+		bytes -= got;
+		offset += got;
+	}
+
+	return 0;
+}
+
+/** the bands in order, sweep after sweep, as long as a buffer is free; the first sweep is checked
+ * against the checksum of the header before its last band is handed out
+ * **/
+static void *reader(void *pvoidedstream)
+{
+	pwrstream *pstream = (pwrstream *) pvoidedstream;
+	int slot, band, error, first;
+	size_t bytes;
+	uint64_t hash = MATCHECKSUMSEED;
+
+	pthread_mutex_lock(&pstream->mutex);
+	for (;;) {
+		while (!pstream->closing && pstream->produced - pstream->consumed >= STREAMBUFFERS)
+			pthread_cond_wait(&pstream->free, &pstream->mutex);
+		if (pstream->closing)
+			break;
+		slot = (int)(pstream->produced % STREAMBUFFERS);
+		band = (int)(pstream->produced % pstream->nbands);
+		first = pstream->produced < pstream->nbands;
+		pthread_mutex_unlock(&pstream->mutex);
+
+		/** the worker does not touch this buffer until produced moves past it **/
+		error = readband(pstream, band, pstream->buffer[slot], &bytes);
+		if (!error && first) {
+			hash = PWRchecksum(hash, pstream->buffer[slot], bytes);
+			error = 2*(band == pstream->nbands - 1 && hash != pstream->checksum);
+		}
+
+		pthread_mutex_lock(&pstream->mutex);
+		if (error && !pstream->failed) {
+			printf(error == 1 ? "out of core: read error on band %d, stopping\n" : "out of core: checksum mismatch after band %d, stopping\n", band);
+			pstream->failed = 1;
+			*pstream->pstop = 1;
+		}
+		pstream->bytesread += bytes;
+		pstream->bufferband[slot] = band;
+		++pstream->produced;
+		pthread_cond_signal(&pstream->ready);
+	}
+	pthread_mutex_unlock(&pstream->mutex);
+
+	return NULL;
+}
+
+/** budget: bytes of matrix the stream may hold, STREAMBUFFERS bands of at least one row each **/
+int PWRstreamopen(pwrstream *pstream, char *filename, size_t budget, volatile sig_atomic_t *pstop)
+{
+	int retcode = 0, n, i, b;
+	pwrmatheader header;
+	size_t rowbytes, bytes;
+
+	memset(pstream, 0, sizeof(pwrstream));
+	pstream->fd = -1;
+	pthread_mutex_init(&pstream->mutex, NULL);
+	pthread_cond_init(&pstream->ready, NULL);
+	pthread_cond_init(&pstream->free, NULL);
+	pstream->pstop = pstop;
+
+	if (openpacked(filename, &pstream->fd, &header)) {
+		retcode = 1; goto BACK;
+	}
+	n = pstream->n = (int) header.n;
+	pstream->dataoffset = header.dataoffset;
+	pstream->checksum = header.checksum;
+	posix_fadvise(pstream->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+	pstream->bandbytes = budget/STREAMBUFFERS;
+	if (pstream->bandbytes < n*sizeof(double))
+		pstream->bandbytes = n*sizeof(double); /** the first row **/
+	if (pstream->bandbytes > header.databytes)
+		pstream->bandbytes = header.databytes;
+
+	/** rows get shorter, the bands get more rows as they go **/
+	pstream->bandrow = (int *)calloc(n + 1, sizeof(int));
+	if (pstream->bandrow == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	for (i = 0, b = 0; i < n; b++) {
+		pstream->bandrow[b] = i;
+		for (bytes = 0; i < n && bytes + (rowbytes = (n - i)*sizeof(double)) <= pstream->bandbytes; i++)
+			bytes += rowbytes;
+	}
+	pstream->bandrow[b] = n;
+	pstream->nbands = b;
+
+	for (b = 0; b < STREAMBUFFERS; b++)
+		if ((pstream->buffer[b] = (double *)malloc(pstream->bandbytes)) == NULL) {
+			retcode = NOMEMORY; goto BACK;
+		}
+
+	pstream->start = PWRseconds();
+	if (pthread_create(&pstream->reader, NULL, &reader, (void *) pstream)) {
+		printf("cannot start the out of core reader\n"); retcode = 1; goto BACK;
+	}
+	pstream->started = 1;
+
+	BACK:
+	if (retcode)
+		PWRstreamclose(pstream, -1);
+	return retcode;
+}
+
+/** stops the reader and reports what the stream did for worker ID (nothing if ID < 0) **/
+void PWRstreamclose(pwrstream *pstream, int ID)
+{
+	int b;
+	double seconds = PWRseconds() - pstream->start;
+
+	if (pstream->started) {
+		pthread_mutex_lock(&pstream->mutex);
+		pstream->closing = 1;
+		pthread_cond_signal(&pstream->free);
+		pthread_mutex_unlock(&pstream->mutex);
+		pthread_join(pstream->reader, NULL);
+		pstream->started = 0;
+		if (ID >= 0)
+			printf("out of core: worker %d read %.1f MB in %ld sweeps of %d bands, %.1f MB/s, waited %.3f s of %.3f s for the disk\n", ID,
+					pstream->bytesread/1048576.0, pstream->sweeps, pstream->nbands, seconds > 0 ? pstream->bytesread/1048576.0/seconds : 0,
+					pstream->waitseconds, seconds);
+	}
+	for (b = 0; b < STREAMBUFFERS; b++) {
+		free(pstream->buffer[b]);
+		pstream->buffer[b] = NULL;
+	}
+	free(pstream->bandrow);
+	pstream->bandrow = NULL;
+	if (pstream->fd >= 0)
+		close(pstream->fd);
+	pstream->fd = -1;
+	pthread_cond_destroy(&pstream->ready);
+	pthread_cond_destroy(&pstream->free);
+	pthread_mutex_destroy(&pstream->mutex);
+}
+
+/** Y = Q X for a block of m vectors (m x n), one pass over the file **/
+void PWRstreamsymm(pwrstream *pstream, int m, const double *x, double *y)
+{
+	int b, c, slot, failed;
+	double wait;
+
+	for (c = 0; c < m; c++)
+		memset(&y[(size_t)c*pstream->n], 0, pstream->n*sizeof(double));
+
+	for (b = 0; b < pstream->nbands; b++) {
+		pthread_mutex_lock(&pstream->mutex);
+		if (pstream->produced <= pstream->consumed) {
+			wait = PWRseconds();
+			while (pstream->produced <= pstream->consumed)
+				pthread_cond_wait(&pstream->ready, &pstream->mutex);
+			pstream->waitseconds += PWRseconds() - wait;
+		}
+		slot = (int)(pstream->consumed % STREAMBUFFERS);
+		failed = pstream->failed;
+		pthread_mutex_unlock(&pstream->mutex);
+
+		/** every sweep takes all the bands in order, this is band b **/
+		if (!failed)
+			KRNsymmband(pstream->n, m, PRECDOUBLE, pstream->buffer[slot], x, y, pstream->bandrow[b], pstream->bandrow[b + 1], NULL);
+
+		pthread_mutex_lock(&pstream->mutex);
+		++pstream->consumed;
+		pthread_cond_signal(&pstream->free);
+		pthread_mutex_unlock(&pstream->mutex);
+	}
+	++pstream->sweeps;
+}
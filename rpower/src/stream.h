@@ -0,0 +1,53 @@
+#ifndef STREAM
+#define STREAM
+
+#include <stdint.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+/** Out of core matvecs (-O megabytes): the packed matrix stays in its binary file (matio.h) and
+ * every product streams it from the disk through a bounded amount of memory. The rows are cut in
+ * bands of at most a quarter of the budget; a reader thread preads them in order into a ring of
+ * STREAMBUFFERS buffers, running ahead of the sweep and on into the next sweep, while the worker
+ * multiplies the band it holds (KRNsymmband). A sweep applies the matrix to all the vectors of a
+ * block at once, so the batch (-b) and subspace engines read the file once for all their jobs or
+ * vectors. Every worker has its own stream: -w 1 with a large -b makes the most of the disk.
+ * A read error, or data that do not match the checksum of the header (checked during the first
+ * sweep, before its last band is multiplied), stops the run like SIGINT: the jobs end interrupted.
+ * **/
+
+#define STREAMBUFFERS 4
+
+typedef struct pwrstream{
+	int fd;
+	int n;
+	off_t dataoffset;
+	uint64_t checksum; /** of the data, from the header, checked by the first sweep **/
+	int nbands;
+	int *bandrow; /** nbands + 1 row boundaries **/
+	size_t bandbytes; /** size of a buffer **/
+	double *buffer[STREAMBUFFERS];
+	int bufferband[STREAMBUFFERS]; /** band held by every buffer **/
+	long produced; /** bands read since the start, band produced % nbands goes next into buffer produced % STREAMBUFFERS **/
+	long consumed; /** bands multiplied since the start **/
+	int closing;
+	int failed; /** a read failed or the checksum did not match, under the mutex like bytesread **/
+	pthread_t reader;
+	int started;
+	pthread_mutex_t mutex;
+	pthread_cond_t ready; /** a band was read **/
+	pthread_cond_t free; /** a buffer was given back **/
+	volatile sig_atomic_t *pstop;
+	double bytesread;
+	double waitseconds; /** the worker waiting for the disk **/
+	double start;
+	long sweeps;
+}pwrstream;
+
+int PWRstreamprobe(char *filename, int *pn, uint64_t *pchecksum);
+int PWRstreamopen(pwrstream *pstream, char *filename, size_t budget, volatile sig_atomic_t *pstop);
+void PWRstreamclose(pwrstream *pstream, int ID);
+void PWRstreamsymm(pwrstream *pstream, int m, const double *x, double *y);
+
+#endif
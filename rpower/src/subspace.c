@@ -0,0 +1,124 @@
+#include <pthread.h>
+#include "utilities.h"
+#include "power.h"
+#include "linalg.h"
+
+/** Block subspace iteration: the r eigen pairs are computed together on an r x n block.
+ * Each iteration applies Q once to the whole block (KRNsymm streams the matrix a single time),
+ * then a Rayleigh-Ritz step on the r x r projected matrix gives the eigen value estimates and
+ * rotates the block onto the Ritz vectors before re-orthonormalizing.
+ * No deflation is needed, the operator only carries the perturbation.
+ * In a low precision run the block is iterated on the low precision matrix until it converges or
+ * stalls, then on the double one until it converges again.
+ * Results go to the same eigenvalue / vector fields as the power method.
+ * **/
+
+/** Rayleigh-Ritz on X with Y = Q X: eigenvalue receives the Ritz values,
+ * u the Ritz vectors X V and x is overwritten with Y V = Q U
+ * **/
+static void rayleighritz(int n, int r, double *x, double *y, double *u, double *h, double *v, double *eigenvalue)
+{
+	int a, c;
+
+	/** H = X^T Q X, symmetrized **/
+	for (a = 0; a < r; a++)
+		for (c = a; c < r; c++)
+			h[a*r + c] = h[c*r + a] = 0.5*(LINdot(n, &x[a*n], &y[c*n]) + LINdot(n, &x[c*n], &y[a*n]));
+
+	LINjacobi(r, h, eigenvalue, v);
+
+	memset(u, 0, (size_t)r*n*sizeof(double));
+	for (c = 0; c < r; c++)
+		for (a = 0; a < r; a++)
+			LINaxpy(n, v[a*r + c], &x[a*n], &u[c*n]);
+
+	memset(x, 0, (size_t)r*n*sizeof(double));
+	for (c = 0; c < r; c++)
+		for (a = 0; a < r; a++)
+			LINaxpy(n, v[a*r + c], &y[a*n], &x[c*n]);
+}
+
+/** returns 1 if the job was interrupted **/
+int PWRsubspace(powerbag *pbag)
+{
+	int n, r, ID, k, c, j, stall = 0;
+	double *x, *y, *u, *h, *v, *xc, *uc;
+	double error, maxerror, tolerance, best = HUGE_VAL;
+	int interrupting = 0;
+	pwroperator op;
+
+	ID = pbag->ID;
+	n = pbag->n;
+	r = pbag->r;
+	tolerance = pbag->tolerance;
+	x = pbag->vector;
+	y = pbag->newvector;
+	u = pbag->vector0; /** the starting block is only needed once, then it holds the Ritz vectors **/
+	h = pbag->smallwork;
+	v = &pbag->smallwork[r*r];
+
+	/** Q = Q0 + s s^T, nothing deflated **/
+	OPinit(&op, n, pbag->qcopy, pbag->scratch, NULL, NULL);
+	op.pteam = pbag->pteam;
+	OPlowprecision(&op, pbag->precision, pbag->lowmatrix);
+	OPfactor(&op, pbag->factor, pbag->factorwork);
+	OPstream(&op, pbag->stream);
+
+	memcpy(x, pbag->vector0, (size_t)r*n*sizeof(double));
+	LINorthonormalize(n, r, x);
+	pbag->iterations[0] = 0;
+	pbag->refined[0] = 0;
+
+	for (k = 0; ; k++) {
+		/** Y = Q X, one sweep over Q for the whole block **/
+		OPapply(&op, r, x, y, NULL);
+		if (op.precision == PRECDOUBLE && pbag->precision != PRECDOUBLE)
+			pbag->refined[0] += r;
+
+		rayleighritz(n, r, x, y, u, h, v, pbag->eigenvalue);
+		++pbag->iterations[0];
+
+		LINorthonormalize(n, r, x);
+
+		/** same error measure as the power method, on every pair **/
+		maxerror = 0;
+		for (c = 0; c < r; c++) {
+			xc = &x[c*n];
+			uc = &u[c*n];
+			if (LINdot(n, xc, uc) < 0)
+				for (j = 0; j < n; j++)
+					xc[j] = -xc[j];
+			error = 0;
+			for (j = 0; j < n; j++)
+				error += fabs(xc[j] - uc[j]);
+			error /= n;
+			if (error > maxerror)
+				maxerror = error;
+		}
+
+		if(0 == k%100){
+			pthread_mutex_lock(pbag->poutputmutex);
+			printf("ID %d at block iteration %d, top eigenvalue %g, ", ID, k, pbag->eigenvalue[0]);
+			printf("  max L1(error) = %.9e\n", maxerror);
+			pthread_mutex_unlock(pbag->poutputmutex);
+		}
+
+		if (op.precision != PRECDOUBLE && PWRlowphasedone(maxerror, tolerance, &best, &stall)) {
+			/** done with the low precision matrix, go on with the double one **/
+			op.precision = PRECDOUBLE;
+		}
+		else if (op.precision == PRECDOUBLE && maxerror < tolerance) {
+			pthread_mutex_lock(pbag->poutputmutex);
+			printf(" ID %d block converged to tolerance %g! on job %d at iteration %d\n", ID, tolerance, pbag->jobnumber, k);
+			for (c = 0; c < r; c++)
+				printf(" ID %d %d-th eigenvalue:  %g!\n", ID, c, pbag->eigenvalue[c]);
+			pthread_mutex_unlock(pbag->poutputmutex);
+			break;
+		}
+
+		if ((interrupting = PWRcheckinterrupt(pbag, k, maxerror)))
+			break;
+	}
+
+	return interrupting;
+}
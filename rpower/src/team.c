@@ -0,0 +1,252 @@
+#include "utilities.h"
+#include "power.h"
+#include "kernels.h"
+#include "linalg.h"
+#include "team.h"
+
+/** Intra-job parallelism. One worker can own a team of threads that share its job:
+ * the packed matrix is cut in row blocks holding the same number of entries, every member
+ * multiplies its rows into a private buffer (rows of the upper triangle also write below the
+ * block, so private buffers avoid any locking), then after a barrier every member sums the
+ * buffers over its own index range, applies the operator corrections and computes its part
+ * of the norms. The normalization and error pass is split the same way.
+ * **/
+
+#define TASKSYMM 1
+#define TASKSCALEERROR 2
+
+typedef struct teammember{
+	pwrteam *pteam;
+	int member;
+}teammember;
+
+static void runtask(pwrteam *pteam, int t)
+{
+	int n = pteam->n, m = pteam->m, size = pteam->size, maxm = pteam->maxm;
+	int c, u, f, j, rb, jb, je, from, ncoef;
+	double *p, *y, *coef, sum;
+	pwroperator *op = pteam->op;
+
+	jb = (int)((long)t*n/size);
+	je = (int)((long)(t + 1)*n/size);
+
+	switch (pteam->task) {
+	case TASKSYMM:
+		rb = pteam->rowbegin[t];
+		p = &pteam->partial[(size_t)t*maxm*n];
+		for (c = 0; c < m; c++)
+			memset(&p[(size_t)c*n + rb], 0, (n - rb)*sizeof(double));
+		KRNsymmrows(n, m, pteam->precision, pteam->packed, pteam->x, p, rb, pteam->rowbegin[t + 1], NULL);
+
+		pthread_barrier_wait(&pteam->middle);
+
+		ncoef = op ? 1 + op->ndeflated : 0;
+		for (c = 0; c < m; c++) {
+			y = &pteam->y[(size_t)c*n];
+			memset(&y[jb], 0, (je - jb)*sizeof(double));
+			/** member u only wrote from its first row onwards **/
+			for (u = 0; u < size; u++) {
+				from = pteam->rowbegin[u] > jb ? pteam->rowbegin[u] : jb;
+				if (from < je)
+					LINaxpy(je - from, 1.0, &pteam->partial[(size_t)u*maxm*n + (size_t)c*n + from], &y[from]);
+			}
+			if (op) {
+				coef = &pteam->coef[c*ncoef];
+				if (op->s)
+					LINaxpy(je - jb, coef[0], &op->s[jb], &y[jb]);
+				for (f = 0; f < op->ndeflated; f++)
+					LINaxpy(je - jb, coef[1 + f], &op->w[(size_t)f*n + jb], &y[jb]);
+			}
+			pteam->sums[t*maxm + c] = LINdot(je - jb, &y[jb], &y[jb]);
+		}
+		break;
+
+	case TASKSCALEERROR:
+		sum = 0;
+		for (j = jb; j < je; j++) {
+			pteam->y[j] *= pteam->mult;
+			sum += fabs(pteam->y[j] - pteam->x[j]);
+		}
+		pteam->sums[t*maxm] = sum;
+		break;
+	}
+}
+
+static void *helper(void *pvoidedmember)
+{
+	teammember *pmember = (teammember *) pvoidedmember;
+	pwrteam *pteam = pmember->pteam;
+
+	for (;;) {
+		pthread_barrier_wait(&pteam->start);
+		if (pteam->quit)
+			break;
+		runtask(pteam, pmember->member);
+		pthread_barrier_wait(&pteam->end);
+	}
+
+	return NULL;
+}
+
+/** run the current task on every member, the caller being member 0 **/
+static void runteam(pwrteam *pteam)
+{
+	pthread_barrier_wait(&pteam->start);
+	runtask(pteam, 0);
+	pthread_barrier_wait(&pteam->end);
+}
+
+/** size threads in all (size - 1 helpers are started), for blocks of at most maxm vectors
+ * and operators with at most maxdeflated deflated pairs
+ * **/
+int PWRteamcreate(pwrteam **ppteam, int size, int n, int maxm, int maxdeflated)
+{
+	int retcode = 0, t, i;
+	size_t total, done;
+	pwrteam *pteam = NULL;
+	teammember *members = NULL;
+
+	pteam = (pwrteam *)calloc(1, sizeof(pwrteam));
+	if (pteam == NULL) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	pteam->size = size;
+	pteam->n = n;
+	pteam->maxm = maxm;
+	pteam->threads = (pthread_t *)calloc(size, sizeof(pthread_t));
+	pteam->rowbegin = (int *)calloc(size + 1, sizeof(int));
+	pteam->partial = (double *)calloc((size_t)size*maxm*n, sizeof(double));
+	pteam->sums = (double *)calloc((size_t)size*maxm, sizeof(double));
+	pteam->coef = (double *)calloc((size_t)maxm*(1 + maxdeflated), sizeof(double));
+	members = (teammember *)calloc(size, sizeof(teammember));
+	if (!pteam->threads || !pteam->rowbegin || !pteam->partial || !pteam->sums || !pteam->coef || !members) {
+		retcode = NOMEMORY; goto BACK;
+	}
+
+	/** row i holds n - i packed entries, give every member the same amount of entries **/
+	total = KRNpackedsize(n);
+	done = 0;
+	for (t = 0, i = 0; t < size; t++) {
+		pteam->rowbegin[t] = i;
+		while (i < n && done < total*(t + 1)/size) {
+			done += n - i;
+			++i;
+		}
+	}
+	pteam->rowbegin[size] = n;
+
+	pthread_barrier_init(&pteam->start, NULL, size);
+	pthread_barrier_init(&pteam->middle, NULL, size);
+	pthread_barrier_init(&pteam->end, NULL, size);
+
+	for (t = 1; t < size; t++) {
+		members[t].pteam = pteam;
+		members[t].member = t;
+		pthread_create(&pteam->threads[t], NULL, &helper, (void *) &members[t]);
+	}
+	pteam->members = members;
+
+	BACK:
+	if (retcode != 0) {
+		if (pteam) {
+			free(pteam->threads); free(pteam->rowbegin); free(pteam->partial);
+			free(pteam->sums); free(pteam->coef);
+		}
+		free(members);
+		free(pteam);
+		pteam = NULL;
+	}
+	*ppteam = pteam;
+	return retcode;
+}
+
+void PWRteamdestroy(pwrteam **ppteam)
+{
+	pwrteam *pteam = *ppteam;
+	int t;
+
+	if (pteam == NULL) return;
+
+	pteam->quit = 1;
+	pthread_barrier_wait(&pteam->start);
+	for (t = 1; t < pteam->size; t++)
+		pthread_join(pteam->threads[t], NULL);
+
+	pthread_barrier_destroy(&pteam->start);
+	pthread_barrier_destroy(&pteam->middle);
+	pthread_barrier_destroy(&pteam->end);
+	free(pteam->threads); free(pteam->rowbegin); free(pteam->partial);
+	free(pteam->sums); free(pteam->coef);
+	free(pteam->members);
+	free(pteam);
+	*ppteam = NULL;
+}
+
+/** Y = Q X (+ the corrections of op if not NULL), norm2 (if not NULL) gets the squared column norms
+ * packed holds Q in the given storage precision
+ * without a team this is KRNsymm followed by OPcorrect
+ * **/
+void PWRteamsymm(pwrteam *pteam, int n, int m, int precision, const void *packed, const double *x, double *y, pwroperator *op, double *norm2)
+{
+	int c, f, t, ncoef;
+	const double *xc;
+
+	if (pteam == NULL || m > pteam->maxm) {
+		KRNsymm(n, m, precision, packed, x, y, op ? NULL : norm2);
+		if (op)
+			for (c = 0; c < m; c++) {
+				OPcorrect(op, (double *) &x[(size_t)c*n], &y[(size_t)c*n]);
+				if (norm2)
+					norm2[c] = LINdot(n, &y[(size_t)c*n], &y[(size_t)c*n]);
+			}
+		return;
+	}
+
+	/** the corrections only depend on x, their coefficients are known before the product **/
+	if (op) {
+		ncoef = 1 + op->ndeflated;
+		for (c = 0; c < m; c++) {
+			xc = &x[(size_t)c*n];
+			pteam->coef[c*ncoef] = op->s ? LINdot(n, op->s, (double *) xc) : 0;
+			for (f = 0; f < op->ndeflated; f++)
+				pteam->coef[c*ncoef + 1 + f] = -op->lambda[f]*LINdot(n, &op->w[(size_t)f*n], (double *) xc);
+		}
+	}
+
+	pteam->task = TASKSYMM;
+	pteam->m = m;
+	pteam->precision = precision;
+	pteam->packed = packed;
+	pteam->x = x;
+	pteam->y = y;
+	pteam->op = op;
+	runteam(pteam);
+
+	if (norm2)
+		for (c = 0; c < m; c++) {
+			norm2[c] = 0;
+			for (t = 0; t < pteam->size; t++)
+				norm2[c] += pteam->sums[t*pteam->maxm + c];
+		}
+}
+
+/** newvector *= mult, returns the L1 distance to vector divided by n **/
+double PWRteamscale_error(pwrteam *pteam, int n, double mult, double *newvector, double *vector)
+{
+	int t;
+	double error = 0;
+
+	if (pteam == NULL)
+		return KRNscale_error(n, mult, newvector, vector);
+
+	pteam->task = TASKSCALEERROR;
+	pteam->mult = mult;
+	pteam->x = vector;
+	pteam->y = newvector;
+	runteam(pteam);
+
+	for (t = 0; t < pteam->size; t++)
+		error += pteam->sums[t*pteam->maxm];
+
+	return error/n;
+}
@@ -0,0 +1,43 @@
+#ifndef TEAM
+#define TEAM
+
+#include <pthread.h>
+#include "operator.h"
+
+/** below this size a job is not worth splitting across threads **/
+#define TEAMMINN 1000
+
+/** a thread team working on one job: the caller is member 0, the others are helper threads
+ * that sleep on a barrier between tasks; matvecs are split by row blocks, reductions by
+ * index ranges
+ * **/
+typedef struct pwrteam{
+	int size;
+	int n;
+	int maxm; /** widest block the team can multiply **/
+	pthread_t *threads;
+	void *members; /** arguments of the helper threads **/
+	pthread_barrier_t start, middle, end;
+	int *rowbegin; /** size + 1 row bounds, balanced on packed entries **/
+	double *partial; /** size private m x n products **/
+	double *sums; /** size x maxm partial reductions **/
+	double *coef; /** maxm x (1 + deflated) correction coefficients of the operator **/
+
+	/** current task **/
+	int task;
+	int quit;
+	int m;
+	int precision;
+	const void *packed;
+	const double *x;
+	double *y;
+	pwroperator *op;
+	double mult;
+}pwrteam;
+
+int PWRteamcreate(pwrteam **ppteam, int size, int n, int maxm, int maxdeflated);
+void PWRteamdestroy(pwrteam **ppteam);
+void PWRteamsymm(pwrteam *pteam, int n, int m, int precision, const void *packed, const double *x, double *y, pwroperator *op, double *norm2);
+double PWRteamscale_error(pwrteam *pteam, int n, double mult, double *newvector, double *vector);
+
+#endif
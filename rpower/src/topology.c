@@ -0,0 +1,202 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include "utilities.h"
+#include "power.h"
+#include "topology.h"
+
+/** cpus of a sysfs list like "0-3,8-11" that are also in allowed, in mask **/
+static void readcpulist(char *filename, cpu_set_t *allowed, cpu_set_t *mask)
+{
+	FILE *input;
+	int first, last, c;
+	char separator;
+
+	CPU_ZERO(mask);
+	if ((input = fopen(filename, "r")) == NULL)
+		return;
+	while (fscanf(input, "%d", &first) == 1) {
+		last = first;
+		separator = (char) fgetc(input);
+		if (separator == '-') {
+			if (fscanf(input, "%d", &last) != 1)
+				break;
+			separator = (char) fgetc(input);
+		}
+		for (c = first; c <= last && c < CPU_SETSIZE; c++)
+			if (CPU_ISSET(c, allowed))
+				CPU_SET(c, mask);
+		if (separator != ',')
+			break;
+	}
+	fclose(input);
+}
+
+/** 1 if cpu is the second (or later) hardware thread of its core **/
+static int secondthread(int cpu)
+{
+	char filename[128];
+	FILE *input;
+	int leader = cpu;
+
+	snprintf(filename, sizeof(filename), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", cpu);
+	if ((input = fopen(filename, "r")) != NULL) {
+		if (fscanf(input, "%d", &leader) != 1)
+			leader = cpu;
+		fclose(input);
+	}
+
+	return leader != cpu;
+}
+
+/** fills the placement order: first hardware thread of every core before the second ones, then
+ * node after node (compact) or alternating between nodes (scatter)
+ * **/
+int PWRtopologyinit(pwrtopology *ptopo, int placement)
+{
+	int retcode = 0, c, k, id, pass, count, taken;
+	int *nodeid = NULL;
+	cpu_set_t allowed, nodemask[TOPOMAXNODES];
+	char filename[128];
+
+	memset(ptopo, 0, sizeof(pwrtopology));
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		printf("cannot read the cpu affinity\n");
+		retcode = 1; goto BACK;
+	}
+
+	/** nodes with usable cpus in increasing id order, a single one when sysfs has no node directory **/
+	for (id = 0; id < TOPOMAXNODEID && ptopo->nnodes < TOPOMAXNODES; id++) {
+		snprintf(filename, sizeof(filename), "/sys/devices/system/node/node%d/cpulist", id);
+		readcpulist(filename, &allowed, &nodemask[ptopo->nnodes]);
+		if (CPU_COUNT(&nodemask[ptopo->nnodes]) > 0)
+			++ptopo->nnodes;
+	}
+	if (ptopo->nnodes == 0) {
+		nodemask[0] = allowed;
+		ptopo->nnodes = 1;
+	}
+
+	count = CPU_COUNT(&allowed);
+	ptopo->cpu = (int *)calloc(count, sizeof(int));
+	ptopo->node = (int *)calloc(count, sizeof(int));
+	nodeid = (int *)calloc(ptopo->nnodes, sizeof(int)); /** next cpu to look at in every node **/
+	if (!ptopo->cpu || !ptopo->node || !nodeid) {
+		retcode = NOMEMORY; goto BACK;
+	}
+	for (k = 0; k < ptopo->nnodes; k++)
+		ptopo->nodecpus[k] = CPU_COUNT(&nodemask[k]);
+
+	for (pass = 0; pass < 2; pass++) {
+		memset(nodeid, 0, ptopo->nnodes*sizeof(int));
+		if (placement == PLACESCATTER) {
+			/** one cpu of every node in turn **/
+			do {
+				taken = 0;
+				for (k = 0; k < ptopo->nnodes; k++) {
+					for (c = nodeid[k]; c < CPU_SETSIZE && !(CPU_ISSET(c, &nodemask[k]) && secondthread(c) == pass); c++);
+					nodeid[k] = c + 1;
+					if (c < CPU_SETSIZE && ptopo->ncpus < count) {
+						ptopo->cpu[ptopo->ncpus] = c;
+						ptopo->node[ptopo->ncpus++] = k;
+						taken = 1;
+					}
+				}
+			} while (taken);
+		}
+		else {
+			for (k = 0; k < ptopo->nnodes; k++)
+				for (c = 0; c < CPU_SETSIZE; c++)
+					if (CPU_ISSET(c, &nodemask[k]) && secondthread(c) == pass && ptopo->ncpus < count) {
+						ptopo->cpu[ptopo->ncpus] = c;
+						ptopo->node[ptopo->ncpus++] = k;
+					}
+		}
+	}
+
+	BACK:
+	free(nodeid);
+	if (retcode)
+		PWRtopologyfree(ptopo);
+	return retcode;
+}
+
+void PWRtopologyfree(pwrtopology *ptopo)
+{
+	free(ptopo->cpu);
+	free(ptopo->node);
+	ptopo->cpu = ptopo->node = NULL;
+	ptopo->ncpus = 0;
+}
+
+/** pins the calling thread to count entries of the placement order from first (wrapping around),
+ * threads it creates afterwards inherit the mask
+ * **/
+int PWRpin(pwrtopology *ptopo, int first, int count)
+{
+	int j;
+	cpu_set_t mask;
+
+	CPU_ZERO(&mask);
+	for (j = 0; j < count; j++)
+		CPU_SET(ptopo->cpu[(first + j) % ptopo->ncpus], &mask);
+
+	return pthread_setaffinity_np(pthread_self(), sizeof(mask), &mask);
+}
+
+typedef struct replicaorder{
+	pwrtopology *ptopo;
+	int node;
+	const double *matrix;
+	size_t count;
+	double *replica;
+}replicaorder;
+
+/** runs pinned on the node, so the pages it touches first are local **/
+static void *replicate(void *pvoidedorder)
+{
+	replicaorder *porder = (replicaorder *) pvoidedorder;
+	int j;
+
+	for (j = 0; j < porder->ptopo->ncpus && porder->ptopo->node[j] != porder->node; j++);
+	PWRpin(porder->ptopo, j, 1);
+
+	porder->replica = PWRallocmatrix(porder->count);
+	if (porder->replica != NULL) {
+		memcpy(porder->replica, porder->matrix, porder->count*sizeof(double));
+		PWRsealmatrix(porder->replica, porder->count);
+	}
+
+	return NULL;
+}
+
+/** replica[k] receives a sealed copy of the matrix (count doubles) local to node k, free them with
+ * PWRfreematrix; with a single node there is nothing to gain and replica[0] is the matrix itself
+ * **/
+int PWRreplicate(pwrtopology *ptopo, const double *matrix, size_t count, double **replica)
+{
+	int retcode = 0, k;
+	pthread_t thread[TOPOMAXNODES];
+	replicaorder order[TOPOMAXNODES];
+
+	if (ptopo->nnodes == 1) {
+		replica[0] = (double *) matrix;
+		return 0;
+	}
+
+	/** one node after the other, they all read the same source **/
+	for (k = 0; k < ptopo->nnodes; k++) {
+		order[k].ptopo = ptopo;
+		order[k].node = k;
+		order[k].matrix = matrix;
+		order[k].count = count;
+		order[k].replica = NULL;
+		if (pthread_create(&thread[k], NULL, &replicate, (void *) &order[k]) == 0)
+			pthread_join(thread[k], NULL);
+		replica[k] = order[k].replica;
+		if (replica[k] == NULL)
+			retcode = NOMEMORY;
+	}
+
+	return retcode;
+}
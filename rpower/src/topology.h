@@ -0,0 +1,32 @@
+#ifndef TOPOLOGY
+#define TOPOLOGY
+
+/** NUMA placement of the workers, from /sys/devices/system/node (no libnuma needed).
+ * The usable cpus are listed in placement order: PLACECOMPACT fills node 0 before node 1 (one
+ * socket first), PLACESCATTER alternates between the nodes. Worker j with a team of t threads is
+ * pinned to entries j*t .. j*t + t - 1 (its helpers inherit the mask) and allocates its bag itself,
+ * so that its buffers are first touched on its own node. The shared matrices are replicated once
+ * per node by a thread pinned there (PWRreplicate).
+ * **/
+
+#define PLACENONE 0 /** threads float, the master allocates the bags **/
+#define PLACECOMPACT 1
+#define PLACESCATTER 2
+
+#define TOPOMAXNODES 64
+#define TOPOMAXNODEID 1024 /** node ids looked for in sysfs **/
+
+typedef struct pwrtopology{
+	int ncpus; /** usable cpus **/
+	int *cpu; /** ncpus cpu numbers in placement order **/
+	int *node; /** node of each of them **/
+	int nnodes; /** nodes with usable cpus **/
+	int nodecpus[TOPOMAXNODES]; /** usable cpus of every node **/
+}pwrtopology;
+
+int PWRtopologyinit(pwrtopology *ptopo, int placement);
+void PWRtopologyfree(pwrtopology *ptopo);
+int PWRpin(pwrtopology *ptopo, int first, int count);
+int PWRreplicate(pwrtopology *ptopo, const double *matrix, size_t count, double **replica);
+
+#endif
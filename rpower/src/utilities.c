@@ -0,0 +1,11 @@
+#include <time.h>
+#include "utilities.h"
+
+/** wall clock in seconds, monotonic **/
+double PWRseconds(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + 1e-9*ts.tv_nsec;
+}
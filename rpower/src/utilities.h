@@ -6,4 +6,6 @@
 #include <string.h>
 #include <math.h>
 
+double PWRseconds(void);
+
 #endif